@@ -6,7 +6,8 @@
 //   control-h -- backspace
 //   control-u -- kill line
 //   control-d -- end of file
-//   control-p -- print process list
+//   control-p -- print process list and interrupt counts
+//   control-f -- print free memory fragmentation
 //
 
 #include <stdarg.h>
@@ -79,7 +80,7 @@ consolewrite(int user_src, uint64 src, int n)
 // or kernel address.
 //
 int
-consoleread(int user_dst, uint64 dst, int n)
+consoleread(int user_dst, uint64 dst, int n, uint off)
 {
   uint target;
   int c;
@@ -142,6 +143,12 @@ consoleintr(int c)
   switch(c){
   case C('P'):  // Print process list.
     procdump();
+    intrdump();
+    break;
+  case C('F'):  // Print free memory stats.
+    kmemdump();
+    ptcachedump();
+    swapdump();
     break;
   case C('U'):  // Kill line.
     while(cons.e != cons.w &&
@@ -6,8 +6,11 @@ struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
 struct stat;
 struct superblock;
+struct ushared;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -23,7 +26,7 @@ void            consoleintr(int);
 void            consputc(int);
 
 // exec.c
-int             exec(char*, char**);
+int             exec(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -63,6 +66,17 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           kalloc_pages(int);
+void*           kalloc_zeroed(void);
+int             kzeroidle(void);
+void            kfree_pages(void *, int);
+void            kmemdump(void);
+int             kfreepages(void);
+void            kaddref(void *);
+int             krefcnt(void *);
+
+// meminfo.c
+void            meminfoinit(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -71,6 +85,7 @@ void            begin_op(void);
 void            end_op(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -85,6 +100,7 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, int*, int);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
@@ -103,6 +119,9 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+void            preempt(void);
+void            boost(void);
+int             setnice(int, int);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -118,6 +137,11 @@ void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// slab.c
+void            slabinit(struct slabcache*, char*, uint, void (*)(void*));
+void*           slab_alloc(struct slabcache*);
+void            slab_free(struct slabcache*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -133,6 +157,15 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(uint, struct superblock*);
+void            swapdup(int);
+void            swapput(int);
+int             swapread(int, char*);
+int             swapout(void);
+void            swapdump(void);
+void            swapusage(int*, int*);
+
 // syscall.c
 void            argint(int, int*);
 int             argstr(int, char*, int);
@@ -141,12 +174,25 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// textcache.c
+void            textinit(void);
+char*           textpage(struct inode*, uint, uint);
+void            textinval(struct inode*);
+int             textreclaim(void);
+int             textpages(void);
+
 // trap.c
 extern uint     ticks;
+extern struct ushared *ushared;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            wakeat(uint);
+void            settime(void);
+void            clocktick(void);
+void            clockidle(void);
+void            intrdump(void);
 
 // uart.c
 void            uartinit(void);
@@ -158,18 +204,37 @@ int             uartgetc(void);
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+void            ptcachedump(void);
+void            asidinit(void);
+void            kvmswitch(struct proc*);
+pagetable_t     kvmcreate(pagetable_t);
+void            kvmfree(pagetable_t);
+void            kvmsetuser(pagetable_t, pagetable_t);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
+int             mapsuper(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
+int             uvmdiscard(pagetable_t, uint64, uint64);
+uint64          uvmaccessed(pagetable_t, uint64, int);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
+int             uvmrss(pagetable_t);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
-void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+int             vmfault(pagetable_t, uint64, int);
+void            uvmprefault(uint64, uint64);
+pte_t*          uvmclock(struct proc*, uint64*, int*);
+int             vmacopy(pagetable_t, pagetable_t, struct vma*);
+int             vmaprefault(void);
+void            vmadup(struct vma*, struct vma*);
+void            vmarelease(struct vma*);
+int             vmaunmap(uint64, uint64);
+uint64          vmaplace(uint64, uint64);
+int             vmaoverlap(struct proc*, uint64, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
@@ -183,6 +248,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwpage(uint, void *, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -7,8 +7,6 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
-
 int flags2perm(int flags)
 {
     int perm = 0;
@@ -19,18 +17,23 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Replace p's user memory with the program at path.
+// p is either the caller, or a new process from spawn()
+// that hasn't run yet. Looks up path relative to the
+// caller's current directory.
 int
-exec(char *path, char **argv)
+exec(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
+  uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase, ustackbase;
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct vma vma[NVMA], *v;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
 
+  memset(vma, 0, sizeof(vma));
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -49,8 +52,10 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
-  for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
+  // Record where each segment comes from in the file.
+  // Nothing is read yet: vmfault() reads each page
+  // in when the program first touches it.
+  for(i=0, v=vma, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
     if(ph.type != ELF_PROG_LOAD)
@@ -61,29 +66,35 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    // segments must be in order and not share pages.
+    if(ph.vaddr < PGROUNDUP(sz) || ph.vaddr + ph.memsz > USERTOP)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(v == &vma[NVMA])
       goto bad;
+    v->start = ph.vaddr;
+    v->end = PGROUNDUP(ph.vaddr + ph.memsz);
+    v->perm = PTE_R | flags2perm(ph.flags);
+    v->ip = idup(ip);
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    v++;
+    sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
-  // Allocate some pages at the next page boundary.
-  // Make the first inaccessible as a stack guard.
-  // Use the rest as the user stack.
-  sz = PGROUNDUP(sz);
-  uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, sz, sz + (USERSTACK+1)*PGSIZE, PTE_W)) == 0)
+  // Leave an unmapped guard page at the next page boundary,
+  // then room for MAXSTACK pages of user stack. Allocate the
+  // top USERSTACK pages, for the arguments; vmfault() adds
+  // the rest as the stack grows down into them.
+  sz = PGROUNDUP(sz) + PGSIZE;
+  ustackbase = sz;
+  sz += MAXSTACK*PGSIZE;
+  if(uvmalloc(pagetable, sz - USERSTACK*PGSIZE, sz, PTE_W) == 0)
     goto bad;
-  sz = sz1;
-  uvmclear(pagetable, sz-(USERSTACK+1)*PGSIZE);
   sp = sz;
   stackbase = sp - USERSTACK*PGSIZE;
 
@@ -121,12 +132,24 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  if(p == myproc())
+    vmaunmap(0, MAXVA);
+  // under p->lock, so /meminfo isn't walking oldpagetable
+  // when it is freed.
+  acquire(&p->lock);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  kvmsetuser(p->kpagetable, pagetable);
+  if(p == myproc())
+    sfence_vma();
+  release(&p->lock);
   p->sz = sz;
+  p->stackbase = ustackbase;
+  p->heapbase = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  memmove(p->vma, vma, sizeof(vma));
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -134,33 +157,13 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
+    vmarelease(vma);
     iunlockput(ip);
     end_op();
+  } else {
+    begin_op();
+    vmarelease(vma);
+    end_op();
   }
   return -1;
 }
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
-}
@@ -10,37 +10,39 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 #include "stat.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
+
+// open files are allocated from a slab cache, so the
+// number of them is limited only by memory.
+// ftable.lock protects every file's ref.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.cache, "file", sizeof(struct file), 0);
 }
 
 // Allocate a file structure.
+// Returns 0 if out of memory.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slab_alloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +74,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slab_free(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -111,12 +114,15 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->readable == 0)
     return -1;
 
+  uvmprefault(addr, n);
+
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    if((r = devsw[f->major].read(1, addr, n, f->off)) > 0)
+      f->off += r;
   } else if(f->type == FD_INODE){
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
@@ -139,6 +145,8 @@ filewrite(struct file *f, uint64 addr, int n)
   if(f->writable == 0)
     return -1;
 
+  uvmprefault(addr, n);
+
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
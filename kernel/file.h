@@ -5,7 +5,7 @@ struct file {
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
-  uint off;          // FD_INODE
+  uint off;          // FD_INODE and FD_DEVICE
   short major;       // FD_DEVICE
 };
 
@@ -18,6 +18,7 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *next; // on itable's list of active inodes
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -30,11 +31,13 @@ struct inode {
 };
 
 // map major device number to device functions.
+// read() gets the file offset, for devices that have one.
 struct devsw {
-  int (*read)(int, uint64, int);
+  int (*read)(int, uint64, int, uint);
   int (*write)(int, uint64, int);
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define MEMINFO 2
@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -44,6 +45,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(dev, &sb);
 }
 
 // Zero a block.
@@ -129,12 +131,13 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a table entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in table: the inode table is a list of
+//   in-memory inodes allocated from a slab cache, so its
+//   size is limited only by memory. ip->ref tracks the
+//   number of in-memory pointers to the entry (open files
+//   and current directories). iget() finds or creates a
+//   table entry and increments its ref; iput() decrements
+//   ref, and frees the entry when ref reaches zero.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
@@ -164,8 +167,8 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// The itable.lock spin-lock protects the list of itable
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
 //
@@ -175,18 +178,23 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *list;      // inodes with ref > 0
+  struct slabcache cache;
 } itable;
 
+// slab constructor: each inode's sleep-lock is
+// initialized once, when its slab is created.
+static void
+inodector(void *p)
+{
+  initsleeplock(&((struct inode*)p)->lock, "inode");
+}
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  slabinit(&itable.cache, "inode", sizeof(struct inode), inodector);
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -246,31 +254,29 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = itable.list; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Allocate a new inode entry.
+  if((ip = slab_alloc(&itable.cache)) == 0)
     panic("iget: no inodes");
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = itable.list;
+  itable.list = ip;
   release(&itable.lock);
 
   return ip;
@@ -327,8 +333,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode table entry can
-// be recycled.
+// If that was the last reference, the inode table entry is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -357,7 +363,13 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    struct inode **pp;
+    for(pp = &itable.list; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+    slab_free(&itable.cache, ip);
+  }
   release(&itable.lock);
 }
 
@@ -429,6 +441,7 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  textinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -512,6 +525,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(n > 0)
+    textinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
@@ -1,6 +1,28 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers.
+//
+// Free memory is managed by a binary buddy allocator: a free
+// block of order k is 2^k physically contiguous pages, aligned
+// to its own size. kalloc_pages() hands out such blocks, splitting
+// larger ones as needed, and kfree_pages() coalesces a freed block
+// with its buddy whenever the buddy is free too.
+//
+// Single pages (kalloc()/kfree()) are by far the common case, so
+// each CPU caches order-0 pages on its own free list with its own
+// lock. A CPU refills its list from the buddy allocator in batches,
+// returns a batch when the list grows too long, and as a last resort
+// steals pages cached by another CPU.
+//
+// When a CPU has nothing to run, it zeroes free pages ahead of
+// time and keeps them on a separate list, so that
+// kalloc_zeroed() can usually hand out a zero page without
+// a memset() on the allocation path.
+//
+// Every allocated page has a reference count, so that a page
+// can be mapped by several page tables (e.g. after a
+// copy-on-write fork). kalloc() sets it to 1, kaddref() adds
+// one, and kfree() only frees the page when it drops to 0.
 
 #include "types.h"
 #include "param.h"
@@ -14,19 +36,67 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// most pages that one steal() moves between CPUs.
+#define NSTEAL 64
+
+// a CPU moves pages to and from the buddy allocator KBATCH
+// at a time, and keeps at most KCACHEMAX on its own list.
+#define KBATCH    32
+#define KCACHEMAX 128
+
+// an idle CPU zeroes ZBATCH pages at a time, until
+// NZEROED are waiting on the zeroed list.
+#define ZBATCH  8
+#define NZEROED 256
+
+#define NPAGE    ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PAGENO(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 struct run {
   struct run *next;
+  struct run *prev;  // only used on buddy free lists
 };
 
+// per-page bookkeeping, indexed by PAGENO(pa).
+struct page {
+  char free;   // first page of a free buddy block?
+  char order;  // if so, the order of that block
+  int ref;     // references to an allocated page
+};
+
+struct page pages[NPAGE];
+
+struct {
+  struct spinlock lock;
+  struct run free[MAXORDER+1];  // circular lists of free blocks, by order
+  int nfree[MAXORDER+1];        // number of blocks on each list
+} buddy;
+
 struct {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;             // number of pages on freelist
+} kmem[NCPU];
+
+struct {
+  struct spinlock lock;
+  struct run *list;      // free pages, zero but for the link
+  int n;
+  uint64 hit;            // kalloc_zeroed()s served from the list
+  uint64 miss;           // kalloc_zeroed()s that had to memset()
+} zeroed;
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  initlock(&buddy.lock, "buddy");
+  for(int k = 0; k <= MAXORDER; k++){
+    buddy.free[k].next = &buddy.free[k];
+    buddy.free[k].prev = &buddy.free[k];
+  }
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kmem[i].lock, "kmem");
+  initlock(&zeroed.lock, "zeroed");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -36,30 +106,316 @@ freerange(void *pa_start, void *pa_end)
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
   for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+    kfree_pages(p, 0);
+}
+
+// Put block pa of the given order on the buddy free lists,
+// merging it with its buddy for as long as the buddy is free.
+// Caller must hold buddy.lock.
+static void
+buddy_free(uint64 pa, int order)
+{
+  struct run *r;
+
+  while(order < MAXORDER){
+    uint64 b = pa ^ ((uint64)PGSIZE << order);
+    if(b < PGROUNDUP((uint64)end) || b + ((uint64)PGSIZE << order) > PHYSTOP)
+      break;
+    struct page *bp = &pages[PAGENO(b)];
+    if(!bp->free || bp->order != order)
+      break;
+    // buddy is free and whole; take it off its list and merge.
+    r = (struct run*)b;
+    r->prev->next = r->next;
+    r->next->prev = r->prev;
+    buddy.nfree[order]--;
+    bp->free = 0;
+    if(b < pa)
+      pa = b;
+    order++;
+  }
+
+  r = (struct run*)pa;
+  r->next = buddy.free[order].next;
+  r->prev = &buddy.free[order];
+  r->next->prev = r;
+  buddy.free[order].next = r;
+  buddy.nfree[order]++;
+  pages[PAGENO(pa)].free = 1;
+  pages[PAGENO(pa)].order = order;
+}
+
+// Take a free block of the given order off the buddy lists,
+// splitting a larger block if there is none of that size.
+// Returns 0 if no large enough block is free.
+// Caller must hold buddy.lock.
+static uint64
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER; k++)
+    if(buddy.nfree[k] > 0)
+      break;
+  if(k > MAXORDER)
+    return 0;
+
+  r = buddy.free[k].next;
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  buddy.nfree[k]--;
+  pages[PAGENO(r)].free = 0;
+
+  // give back the upper half until the block is the right size.
+  while(k > order){
+    k--;
+    struct run *h = (struct run*)((uint64)r + ((uint64)PGSIZE << k));
+    h->next = buddy.free[k].next;
+    h->prev = &buddy.free[k];
+    h->next->prev = h;
+    buddy.free[k].next = h;
+    buddy.nfree[k]++;
+    pages[PAGENO(h)].free = 1;
+    pages[PAGENO(h)].order = k;
+  }
+  return (uint64)r;
+}
+
+// Return every page cached on a per-CPU list, or waiting
+// on the zeroed list, to the buddy allocator, so that they
+// can coalesce into larger blocks.
+static void
+drain(void)
+{
+  struct run *r, *next;
+
+  acquire(&zeroed.lock);
+  r = zeroed.list;
+  zeroed.list = 0;
+  zeroed.n = 0;
+  release(&zeroed.lock);
+  if(r){
+    acquire(&buddy.lock);
+    for(; r; r = next){
+      next = r->next;
+      buddy_free((uint64)r, 0);
+    }
+    release(&buddy.lock);
+  }
+
+  for(int i = 0; i < NCPU; i++){
+    acquire(&kmem[i].lock);
+    r = kmem[i].freelist;
+    kmem[i].freelist = 0;
+    kmem[i].nfree = 0;
+    release(&kmem[i].lock);
+
+    if(r == 0)
+      continue;
+    acquire(&buddy.lock);
+    for(; r; r = next){
+      next = r->next;
+      buddy_free((uint64)r, 0);
+    }
+    release(&buddy.lock);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their combined size (so an order-9 block can back a 2MB
+// mapping). Returns 0 if no such block can be found.
+void *
+kalloc_pages(int order)
+{
+  uint64 pa;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+
+  acquire(&buddy.lock);
+  pa = buddy_alloc(order);
+  release(&buddy.lock);
+
+  if(pa == 0 && order > 0){
+    // pages sitting in per-CPU caches may complete a block.
+    drain();
+    acquire(&buddy.lock);
+    pa = buddy_alloc(order);
+    release(&buddy.lock);
+  }
+
+  if(pa){
+    memset((char*)pa, 5, (uint64)PGSIZE << order); // fill with junk
+    for(int i = 0; i < (1 << order); i++)
+      pages[PAGENO(pa) + i].ref = 1;
+  }
+  return (void*)pa;
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Free a block returned by kalloc_pages(order), regardless
+// of its pages' reference counts. (Pages of such a block can
+// also be freed one at a time with kfree().)
+void
+kfree_pages(void *pa, int order)
+{
+  uint64 sz = (uint64)PGSIZE << order;
+
+  if(order < 0 || order > MAXORDER || ((uint64)pa % sz) != 0 ||
+     (char*)pa < end || (uint64)pa + sz > PHYSTOP)
+    panic("kfree_pages");
+
+  for(int i = 0; i < (1 << order); i++)
+    pages[PAGENO(pa) + i].ref = 0;
+
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, sz);
+
+  acquire(&buddy.lock);
+  buddy_free((uint64)pa, order);
+  release(&buddy.lock);
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc(), and free the page if that was the last
+// reference.
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *batch = 0;
+  int id, ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  ref = __sync_sub_and_fetch(&pages[PAGENO(pa)].ref, 1);
+  if(ref < 0)
+    panic("kfree: ref");
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  acquire(&kmem[id].lock);
+  r->next = kmem[id].freelist;
+  kmem[id].freelist = r;
+  kmem[id].nfree++;
+  if(kmem[id].nfree > KCACHEMAX){
+    // too many cached; hand a batch back to the buddy allocator.
+    batch = kmem[id].freelist;
+    for(int i = 1; i < KBATCH; i++)
+      r = r->next;
+    kmem[id].freelist = r->next;
+    kmem[id].nfree -= KBATCH;
+    r->next = 0;
+  }
+  release(&kmem[id].lock);
+  pop_off();
+
+  if(batch){
+    acquire(&buddy.lock);
+    for(; batch; batch = r){
+      r = batch->next;
+      buddy_free((uint64)batch, 0);
+    }
+    release(&buddy.lock);
+  }
+}
+
+// Take up to half of some other CPU's free pages (at most
+// NSTEAL) and put all but one of them on CPU id's list.
+// Returns the remaining page, or 0 if every list is empty.
+// Holds only one kmem lock at a time, so two CPUs stealing
+// from each other can't deadlock.
+// Interrupts must be disabled.
+static struct run*
+steal(int id)
+{
+  struct run *first, *last;
+  int i, n;
+
+  for(i = 1; i < NCPU; i++){
+    int victim = (id + i) % NCPU;
+
+    acquire(&kmem[victim].lock);
+    n = (kmem[victim].nfree + 1) / 2;
+    if(n > NSTEAL)
+      n = NSTEAL;
+    if(n == 0){
+      release(&kmem[victim].lock);
+      continue;
+    }
+    first = last = kmem[victim].freelist;
+    for(int j = 1; j < n; j++)
+      last = last->next;
+    kmem[victim].freelist = last->next;
+    kmem[victim].nfree -= n;
+    release(&kmem[victim].lock);
+
+    if(n > 1){
+      acquire(&kmem[id].lock);
+      last->next = kmem[id].freelist;
+      kmem[id].freelist = first->next;
+      kmem[id].nfree += n - 1;
+      release(&kmem[id].lock);
+    }
+    return first;
+  }
+  return 0;
+}
+
+// Move up to KBATCH single pages from the buddy allocator
+// to CPU id's list, keeping one back for the caller.
+// Returns that page, or 0 if the buddy allocator is empty.
+// Interrupts must be disabled.
+static struct run*
+refill(int id)
+{
+  struct run *first = 0, *r;
+  int n;
+
+  acquire(&buddy.lock);
+  for(n = 0; n < KBATCH; n++){
+    if((r = (struct run*)buddy_alloc(0)) == 0)
+      break;
+    r->next = first;
+    first = r;
+  }
+  release(&buddy.lock);
+
+  if(n > 1){
+    for(r = first->next; r->next; r = r->next)
+      ;
+    acquire(&kmem[id].lock);
+    r->next = kmem[id].freelist;
+    kmem[id].freelist = first->next;
+    kmem[id].nfree += n - 1;
+    release(&kmem[id].lock);
+  }
+  return first;
+}
+
+// Take a page off the zeroed list, or return 0.
+static struct run*
+takezeroed(void)
+{
+  struct run *r;
+
+  acquire(&zeroed.lock);
+  if((r = zeroed.list) != 0){
+    zeroed.list = r->next;
+    zeroed.n--;
+  }
+  release(&zeroed.lock);
+  if(r)
+    r->next = 0;
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +425,157 @@ void *
 kalloc(void)
 {
   struct run *r;
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  acquire(&kmem[id].lock);
+  r = kmem[id].freelist;
+  if(r){
+    kmem[id].freelist = r->next;
+    kmem[id].nfree--;
+  }
+  release(&kmem[id].lock);
+  if(r == 0)
+    r = refill(id);
+  if(r == 0)
+    r = steal(id);
+  pop_off();
+  if(r == 0)
+    r = takezeroed();
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    pages[PAGENO(r)].ref = 1;
+  }
+  return (void*)r;
+}
+
+// Allocate a page of zeroes, preferably one zeroed earlier
+// by an idle CPU. Returns 0 if out of memory.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if((r = takezeroed()) != 0){
+    __sync_fetch_and_add(&zeroed.hit, 1);
+    pages[PAGENO(r)].ref = 1;
+    return (void*)r;
+  }
+  __sync_fetch_and_add(&zeroed.miss, 1);
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
   return (void*)r;
 }
+
+// Called by a CPU with nothing to run: zero a batch of
+// free pages for kalloc_zeroed(). Takes pages from this
+// CPU's free list, or the buddy allocator, but doesn't
+// steal from other CPUs. Returns the number of pages zeroed,
+// 0 once the zeroed list is full or no pages are free.
+int
+kzeroidle(void)
+{
+  struct run *r;
+  int id, n;
+
+  for(n = 0; n < ZBATCH && zeroed.n < NZEROED; n++){
+    push_off();
+    id = cpuid();
+    acquire(&kmem[id].lock);
+    if((r = kmem[id].freelist) != 0){
+      kmem[id].freelist = r->next;
+      kmem[id].nfree--;
+    }
+    release(&kmem[id].lock);
+    pop_off();
+    if(r == 0){
+      acquire(&buddy.lock);
+      r = (struct run*)buddy_alloc(0);
+      release(&buddy.lock);
+      if(r == 0)
+        break;
+    }
+
+    memset((char*)r, 0, PGSIZE);
+
+    acquire(&zeroed.lock);
+    r->next = zeroed.list;
+    zeroed.list = r;
+    zeroed.n++;
+    release(&zeroed.lock);
+  }
+  return n;
+}
+
+// Add a reference to an allocated page, e.g. because
+// another page table now maps it too.
+void
+kaddref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kaddref");
+  if(__sync_fetch_and_add(&pages[PAGENO(pa)].ref, 1) < 1)
+    panic("kaddref: free page");
+}
+
+// Return the number of references to an allocated page.
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&pages[PAGENO(pa)].ref, __ATOMIC_SEQ_CST);
+}
+
+// Return the number of free pages, for /meminfo. Doesn't
+// lock, so it may be a little out of date.
+int
+kfreepages(void)
+{
+  int n = zeroed.n;
+
+  for(int i = 0; i < NCPU; i++)
+    n += kmem[i].nfree;
+  for(int k = 0; k <= MAXORDER; k++)
+    n += buddy.nfree[k] << k;
+  return n;
+}
+
+// Print how free memory is split among block sizes, to
+// show how fragmented physical memory is.
+// Runs when user types ^F on console.
+void
+kmemdump(void)
+{
+  int nblock[MAXORDER+1];
+  int cached = 0, total, largest = -1;
+
+  for(int i = 0; i < NCPU; i++)
+    cached += kmem[i].nfree;
+  total = zeroed.n;
+  acquire(&buddy.lock);
+  for(int k = 0; k <= MAXORDER; k++)
+    nblock[k] = buddy.nfree[k];
+  release(&buddy.lock);
+
+  printf("\nbuddy free blocks by order:\n");
+  total += cached;
+  for(int k = 0; k <= MAXORDER; k++){
+    printf("  order %d (%d pages): %d\n", k, 1 << k, nblock[k]);
+    total += nblock[k] << k;
+    if(nblock[k])
+      largest = k;
+  }
+  printf("cached in per-CPU lists: %d pages\n", cached);
+  printf("zeroed by idle CPUs: %d pages, %ld allocs used one, %ld didn't\n",
+         zeroed.n, zeroed.hit, zeroed.miss);
+  printf("free: %d pages, largest block order %d\n", total, largest);
+  if(total > 0){
+    // fraction of free memory that can't be handed out
+    // as a block as large as the largest one.
+    int frag = 0;
+    if(largest >= 0)
+      frag = 100 - (nblock[largest] << largest) * 100 / total;
+    printf("fragmentation: %d%%\n", frag);
+  }
+}
@@ -19,6 +19,7 @@ main()
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address-space identifiers
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -27,6 +28,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    textinit();      // shared program text cache
+    meminfoinit();   // memory accounting device
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -0,0 +1,151 @@
+//
+// The meminfo device: reading it gives a text report of where
+// memory is going. init makes /meminfo; user/memstat.c prints it.
+//
+// The totals come from counters that the allocators already
+// keep on their alloc and free paths. Each process's resident
+// set is counted by walking its page table when the report is
+// made, so that mapping and unmapping pages costs nothing extra.
+// The report is made afresh by each read(), which returns the
+// part of it at the file offset.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+
+extern struct proc proc[NPROC];
+extern int ptlive;
+
+// a report being written into a page.
+struct report {
+  char *buf;
+  int n;
+};
+
+static void
+putstr(struct report *r, char *s)
+{
+  while(*s && r->n < PGSIZE)
+    r->buf[r->n++] = *s++;
+}
+
+// print x in decimal, right-aligned in width columns.
+static void
+putint(struct report *r, int x, int width)
+{
+  char digits[16];
+  int i = 0;
+
+  do {
+    digits[i++] = '0' + x % 10;
+    x /= 10;
+  } while(x > 0 && i < sizeof(digits));
+  while(width-- > i)
+    putstr(r, " ");
+  while(i > 0 && r->n < PGSIZE)
+    r->buf[r->n++] = digits[--i];
+}
+
+// print "label    n pages\n".
+static void
+putpages(struct report *r, char *label, int n)
+{
+  putstr(r, label);
+  for(int i = strlen(label); i < 16; i++)
+    putstr(r, " ");
+  putint(r, n, 8);
+  putstr(r, " pages\n");
+}
+
+static void
+report(struct report *r)
+{
+  struct slabcache *c;
+  struct proc *p;
+  int used, total, npages, nobj, pid, rss;
+  char name[sizeof(p->name)];
+
+  putpages(r, "free", kfreepages());
+  putpages(r, "page tables", ptlive);
+  putpages(r, "program text", textpages());
+  putpages(r, "buffer cache", NBUF * BSIZE / PGSIZE);
+  for(c = slabcaches; c; c = c->next){
+    acquire(&c->lock);
+    npages = c->nslab;
+    nobj = c->nalloc;
+    release(&c->lock);
+    putstr(r, "slab ");
+    putstr(r, c->name);
+    for(int i = strlen(c->name); i < 11; i++)
+      putstr(r, " ");
+    putint(r, npages, 8);
+    putstr(r, " pages");
+    putint(r, nobj, 8);
+    putstr(r, " objects\n");
+  }
+  swapusage(&used, &total);
+  putpages(r, "swap used", used);
+  putpages(r, "swap total", total);
+
+  putstr(r, "\n     pid      rss name\n");
+  for(p = proc; p < &proc[NPROC]; p++){
+    // p->lock keeps exec() and exit() from freeing the page
+    // table while it is being walked.
+    acquire(&p->lock);
+    if(p->state == UNUSED || p->pagetable == 0){
+      release(&p->lock);
+      continue;
+    }
+    pid = p->pid;
+    rss = uvmrss(p->pagetable);
+    safestrcpy(name, p->name, sizeof(name));
+    release(&p->lock);
+
+    putint(r, pid, 8);
+    putint(r, rss, 9);
+    putstr(r, " ");
+    putstr(r, name);
+    putstr(r, "\n");
+  }
+}
+
+//
+// user read()s from the meminfo device go here.
+// copy (up to) n bytes of the report, starting at
+// offset off, to user address dst.
+//
+int
+meminforead(int user_dst, uint64 dst, int n, uint off)
+{
+  struct report r;
+
+  if((r.buf = kalloc()) == 0)
+    return -1;
+  r.n = 0;
+  report(&r);
+
+  if(off >= r.n)
+    n = 0;
+  else if(n > (int)(r.n - off))
+    n = r.n - off;
+  if(n > 0 && either_copyout(user_dst, dst, r.buf + off, n) < 0)
+    n = -1;
+  kfree(r.buf);
+  return n;
+}
+
+void
+meminfoinit(void)
+{
+  devsw[MEMINFO].read = meminforead;
+  devsw[MEMINFO].write = 0;
+}
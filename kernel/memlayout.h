@@ -25,6 +25,12 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
+// core local interruptor (CLINT). writing 1 to a hart's MSIP
+// register gives it a machine-mode software interrupt, which
+// machinevec in kernelvec.S turns into a supervisor one.
+#define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
+
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
 #define PLIC_PRIORITY (PLIC + 0x0)
@@ -47,13 +53,47 @@
 // each surrounded by invalid guard pages.
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
 
+// map the CLINT's MSIP registers beneath the kernel stacks,
+// rather than at CLINT, which lies in user memory in each
+// process's kernel page table (see kvmcreate()).
+#define KCLINT KSTACK(NPROC)
+#define KCLINT_MSIP(hartid) (KCLINT + 4*(hartid))
+
 // User memory layout.
 // Address zero first:
 //   text
 //   original data and bss
-//   fixed-size stack
+//   stack, growing down on demand
 //   expandable heap
 //   ...
+//   mmap()ed regions, allocated downwards from MMAPTOP
+//   USERTOP
+//   ... (kernel device mappings, no PTE_U)
+//   USHARED (read-only, the same page in every process)
+//   USYSCALL (read-only, p->usyscall)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define USHARED (USYSCALL - PGSIZE)
+
+#ifndef __ASSEMBLER__
+// what user code can read at USYSCALL and USHARED without
+// a system call (see getpid() and uptime() in user/ulib.c).
+struct usyscall {
+  int pid;
+};
+
+struct ushared {
+  uint ticks;
+};
+#endif
+
+// user memory lies below USERTOP, where the kernel's own
+// mappings start, so that each process's kernel page table
+// can map it too (see kvmcreate()).
+#define USERTOP PLIC
+
+// mmap() places regions below MMAPTOP, working downwards;
+// the heap can't grow into them.
+#define MMAPTOP USERTOP
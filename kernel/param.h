@@ -5,11 +5,10 @@
 #endif
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NVMA         16  // demand-paged regions per process
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
@@ -23,12 +22,19 @@
 #endif
 #endif
 #define MAXPATH      128   // maximum file path name
+#define NSWAP        65536 // blocks of swap space, after the file system
+#define MAXORDER     10    // largest physical block is 2^MAXORDER pages
 
 #ifdef LAB_UTIL
 #define USERSTACK    2     // user stack pages
 #else
 #define USERSTACK    1     // user stack pages
 #endif
+#define MAXSTACK     256   // most user stack pages, grown on demand
 
 #define HZ 10  // clock freq: 10 ticks = 1 sec
 
+#define NPRIO        3     // scheduler priority levels; 0 runs first
+#define QUANTUM      1     // time slice at level 0, in ticks; doubles per level
+#define BOOSTTICKS   (5*HZ) // how often every process goes back up
+
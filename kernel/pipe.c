@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +20,15 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+// pipes are allocated from a slab cache, several to a page.
+struct slabcache pipecache;
+
+void
+pipeinit(void)
+{
+  slabinit(&pipecache, "pipe", sizeof(struct pipe), 0);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +38,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)slab_alloc(&pipecache)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -47,7 +57,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    slab_free(&pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +78,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    slab_free(&pipecache, pi);
   } else
     release(&pi->lock);
 }
@@ -120,9 +130,10 @@ piperead(struct pipe *pi, uint64 addr, int n)
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
+    ch = pi->data[pi->nread % PIPESIZE];
     if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+      break;  // leave ch in the pipe.
+    pi->nread++;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
@@ -17,6 +17,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -43,6 +44,52 @@ proc_mapstacks(pagetable_t kpgtbl)
   }
 }
 
+// Each CPU has a queue of RUNNABLE processes, so that the
+// scheduler needn't look through all of proc[] to find one.
+// A process goes on the queue of the CPU it last ran on, whose
+// TLB and caches may still hold some of its state; a CPU whose
+// queue is empty takes a process from the longest queue.
+// A queue's lock is taken after p->lock.
+//
+// The queues are multi-level feedback queues: there is a list
+// for each of NPRIO priorities, and the scheduler runs the
+// processes at priority 0 before those at 1, and so on. A
+// process starts at its nice level, and drops a level each
+// time it uses up a time slice, which is QUANTUM ticks at
+// level 0 and twice as long at each level below. So processes
+// that mostly sleep, like the shell, stay near the top, and
+// ones that compute sink to the bottom. Every BOOSTTICKS
+// ticks, boost() puts every process back at its nice level,
+// so that none wait for ever.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;
+} runq[NCPU];
+
+uint boostgen;  // boost()s so far
+
+// Processes in sleep() are on one of a table of queues,
+// hashed by chan, so that wakeup() needn't look at every
+// process. A queue's lock is taken before p->lock; it is
+// held from when a process joins the queue until its state
+// is SLEEPING, and by wakeup() while it takes processes off.
+#define SLEEPQBITS 6
+#define NSLEEPQ (1 << SLEEPQBITS)
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+} sleepq[NSLEEPQ];
+
+static struct sleepq*
+sleepqueue(void *chan)
+{
+  // chans are addresses, mostly aligned; mix in the high bits.
+  return &sleepq[((uint64)chan * 0x9e3779b97f4a7c15UL) >> (64 - SLEEPQBITS)];
+}
+
 // initialize the proc table.
 void
 procinit(void)
@@ -51,6 +98,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -124,6 +175,11 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->cpu = cpuid();
+  p->nice = 0;
+  p->prio = 0;
+  p->slice = 0;
+  p->boostgen = boostgen;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -132,6 +188,15 @@ found:
     return 0;
   }
 
+  // A page of facts for user code to read, like its pid.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -140,6 +205,14 @@ found:
     return 0;
   }
 
+  // The page table to run on in the kernel.
+  p->kpagetable = kvmcreate(p->pagetable);
+  if(p->kpagetable == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -158,10 +231,19 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
+  if(p->kpagetable)
+    kvmfree(p->kpagetable);
+  p->kpagetable = 0;
+  p->asidgen = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  p->stackbase = 0;
+  p->heapbase = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -202,6 +284,24 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the read-only pages that getpid() and uptime() in
+  // user/ulib.c read, below the trapframe.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+  if(mappages(pagetable, USHARED, PGSIZE,
+              (uint64)ushared, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, USYSCALL, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +312,8 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  uvmunmap(pagetable, USHARED, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -241,6 +343,8 @@ userinit(void)
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
+  p->stackbase = PGSIZE;
+  p->heapbase = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -249,7 +353,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -264,11 +368,17 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    // don't allocate anything yet; vmfault() maps zeroed
+    // pages as the process touches them.
+    if(sz + n > MMAPTOP || vmaoverlap(p, sz, sz + n))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    if(p->heapbase - n > sz)
+      return -1;
+    if(uvmdealloc(p->pagetable, sz, sz + n) != sz + n)
+      return -1;
+    sz += n;
   }
   p->sz = sz;
   return 0;
@@ -283,6 +393,10 @@ fork(void)
   struct proc *np;
   struct proc *p = myproc();
 
+  // so that the child shares every MAP_SHARED page.
+  if(vmaprefault() < 0)
+    return -1;
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -295,6 +409,13 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  np->stackbase = p->stackbase;
+  np->heapbase = p->heapbase;
+  if(vmacopy(p->pagetable, np->pagetable, p->vma) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -307,8 +428,10 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  vmadup(np->vma, p->vma);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->nice = np->prio = p->nice;
 
   pid = np->pid;
 
@@ -319,7 +442,61 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Start a new process running the program at path, without
+// copying the caller's memory the way fork() followed by
+// exec() would. The child's file descriptor i is a dup of
+// the caller's fdmap[i] for i < nfd; it is closed if
+// fdmap[i] is -1, or if i >= nfd. If fdmap is 0, the child
+// gets all of the caller's descriptors. Returns the child's
+// pid, or -1 if the program can't be loaded.
+int
+spawn(char *path, char **argv, int *fdmap, int nfd)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  // np isn't RUNNABLE and has no parent yet, so nothing
+  // else touches it while exec() sleeps reading the file.
+  release(&np->lock);
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = exec(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  for(i = 0; i < NOFILE; i++){
+    if(fdmap == 0){
+      if(p->ofile[i])
+        np->ofile[i] = filedup(p->ofile[i]);
+    } else if(i < nfd && fdmap[i] >= 0){
+      np->ofile[i] = filedup(p->ofile[fdmap[i]]);
+    }
+  }
+  np->cwd = idup(p->cwd);
+  np->nice = np->prio = p->nice;
+
+  pid = np->pid;
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -360,6 +537,9 @@ exit(int status)
     }
   }
 
+  // Write back and unmap mmap()ed files.
+  vmaunmap(0, MAXVA);
+
   begin_op();
   iput(p->cwd);
   end_op();
@@ -394,6 +574,9 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int));
+
   acquire(&wait_lock);
 
   for(;;){
@@ -434,10 +617,180 @@ wait(uint64 addr)
   }
 }
 
+// If there has been a boost() since p last looked, put it
+// back at its nice level. Caller must hold p->lock.
+static void
+boosted(struct proc *p)
+{
+  if(p->boostgen != boostgen){
+    p->boostgen = boostgen;
+    p->prio = p->nice;
+    p->slice = 0;
+  }
+}
+
+// Put p at the end of rq's list for the given level.
+// Caller must hold rq->lock.
+static void
+enqueue(struct runq *rq, struct proc *p, int level)
+{
+  p->rqnext = 0;
+  if(rq->tail[level])
+    rq->tail[level]->rqnext = p;
+  else
+    rq->head[level] = p;
+  rq->tail[level] = p;
+}
+
+// Interrupt CPU id, to get it out of wfi in scheduler().
+static void
+ipi(int id)
+{
+  *(volatile uint32*)KCLINT_MSIP(id) = 1;
+}
+
+// Make p RUNNABLE, and put it at the end of its CPU's run
+// queue for its priority. Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+  int id;
+
+  boosted(p);
+  p->state = RUNNABLE;
+  acquire(&rq->lock);
+  enqueue(rq, p, p->prio);
+  rq->n++;
+  if(cpus[p->cpu].idle){
+    // its CPU is in wfi, and won't look at its queue until
+    // an interrupt; scheduler() marks it idle under rq->lock,
+    // so it can't miss this one.
+    ipi(p->cpu);
+    release(&rq->lock);
+    return;
+  }
+  release(&rq->lock);
+
+  // p's CPU is busy. unless p is just giving up this CPU,
+  // wake an idle CPU, if there is one, to take p from it.
+  if(p == myproc())
+    return;
+  for(id = 0; id < NCPU; id++){
+    if(cpus[id].idle){  // a quick look without the lock.
+      ipi(id);
+      break;
+    }
+  }
+}
+
+// Take the first process at the highest priority on CPU id's
+// run queue. Returns 0 if the queue is empty.
+static struct proc*
+runqget(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p = 0;
+
+  acquire(&rq->lock);
+  for(int i = 0; i < NPRIO; i++){
+    if((p = rq->head[i]) != 0){
+      rq->head[i] = p->rqnext;
+      if(rq->head[i] == 0)
+        rq->tail[i] = 0;
+      rq->n--;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// If every run queue is empty, mark CPU id idle, so that
+// setrunnable() sends it an IPI when there is work, and
+// return 1.
+static int
+runqidle(int id)
+{
+  struct runq *rq = &runq[id];
+  int idle = 0;
+
+  acquire(&rq->lock);
+  if(rq->n == 0)
+    idle = cpus[id].idle = 1;
+  release(&rq->lock);
+  if(idle == 0)
+    return 0;
+
+  // setrunnable() may have queued a process on a busy CPU
+  // since runqsteal() looked, and found no idle CPU to wake.
+  // it adds to n before it looks at idle, and this sets idle
+  // before it looks at n, with a fence (in release()) between
+  // each pair, so at least one of them sees the other.
+  for(int i = 0; i < NCPU; i++){
+    if(runq[i].n > 0){
+      cpus[id].idle = 0;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Move every queued process up to the list for its nice
+// level, and have the rest go back to their nice levels (see
+// boosted()) when they next run or wake up. Queued processes
+// set their prio to match when they run.
+// Called every BOOSTTICKS ticks by clockintr().
+void
+boost(void)
+{
+  struct runq *rq;
+  struct proc *p, *next;
+
+  __sync_fetch_and_add(&boostgen, 1);
+  for(rq = runq; rq < &runq[NCPU]; rq++){
+    acquire(&rq->lock);
+    // each process moves to a level no lower than the one
+    // it is on, so working down from level 1 moves each once.
+    for(int i = 1; i < NPRIO; i++){
+      p = rq->head[i];
+      rq->head[i] = rq->tail[i] = 0;
+      for(; p; p = next){
+        next = p->rqnext;
+        // p->nice without p->lock, which comes before rq->lock;
+        // setnice() leaves queued processes where they are
+        // anyway, so a stale value does no harm.
+        enqueue(rq, p, p->nice < i ? p->nice : i);
+      }
+    }
+    release(&rq->lock);
+  }
+}
+
+// Take a process from the longest run queue, for CPU id,
+// whose own queue is empty. Returns 0 if there is none.
+static struct proc*
+runqsteal(int id)
+{
+  int i, busiest = -1, most = 0;
+
+  // a quick look without the locks; runqget() checks again.
+  for(i = 0; i < NCPU; i++){
+    if(i != id && runq[i].n > most){
+      most = runq[i].n;
+      busiest = i;
+    }
+  }
+  if(busiest < 0)
+    return 0;
+  return runqget(busiest);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run, from this CPU's run queue
+//    or, if that is empty, another CPU's.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -446,6 +799,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = c - cpus;
 
   c->proc = 0;
   for(;;){
@@ -454,29 +808,51 @@ scheduler(void)
     // processes are waiting.
     intr_on();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
+    if((p = runqget(id)) == 0 && (p = runqsteal(id)) == 0){
+      if(kzeroidle() == 0){
+        // nothing to run, and no pages that need zeroing;
+        // stop running on this core until an interrupt, and
+        // stop the clock until a process needs it. interrupts
+        // stay off until the wfi, which returns once one is
+        // pending, so that an IPI sent in between isn't lost.
+        intr_off();
+        if(runqidle(id)){
+          clockidle();
+          asm volatile("wfi");
+          c->idle = 0;
+          // so that ticks is right before anything runs.
+          settime();
+        }
       }
-      release(&p->lock);
-    }
-    if(found == 0) {
-      // nothing to run; stop running on this core until an interrupt.
-      intr_on();
-      asm volatile("wfi");
+      continue;
     }
+
+    // p is off the queues, so no other CPU will run it, but
+    // the CPU that put it there may not have switched away
+    // from it yet; acquire() waits until it has.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    boosted(p);
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    c->proc = p;
+    if(c->clockidle)
+      clocktick();  // so p can be preempted.
+    kvmswitch(p);
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // Stop using its page table while still holding p->lock,
+    // so that wait() can't free it under us.
+    kvmswitch(0);
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -513,11 +889,68 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
 
+// Charge a clock tick to the current process, and give up
+// the CPU if it has used up its time slice, dropping a level,
+// or if a process of higher priority is waiting to run.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+  int higher = 0;
+
+  acquire(&p->lock);
+  boosted(p);
+  if(++p->slice >= QUANTUM << p->prio){
+    if(p->prio < NPRIO - 1)
+      p->prio++;
+    p->slice = 0;
+    higher = 1;
+  }
+  // a quick look without the queue's lock.
+  for(int i = 0; i < p->prio; i++)
+    if(runq[p->cpu].head[i])
+      higher = 1;
+  if(higher){
+    setrunnable(p);
+    sched();
+  }
+  release(&p->lock);
+}
+
+// Set the nice level of the process with the given pid: the
+// highest priority it runs at, from 0 (the default) to
+// NPRIO-1. Returns the old level, or -1.
+int
+setnice(int pid, int nice)
+{
+  struct proc *p;
+  int old;
+
+  if(nice < 0 || nice >= NPRIO)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      old = p->nice;
+      p->nice = nice;
+      // if p is queued, it stays where it is until it runs.
+      if(p->prio < nice){
+        p->prio = nice;
+        p->slice = 0;
+      }
+      release(&p->lock);
+      return old;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -548,21 +981,28 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = sleepqueue(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold chan's queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the queue),
   // so it's okay to release lk.
 
-  acquire(&p->lock);  //DOC: sleeplock1
+  acquire(&q->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sqnext = q->head;
+  q->head = p;
+  release(&q->lock);
 
+  // wakeup() may find p now, but its acquire(&p->lock)
+  // waits until p has switched away.
   sched();
 
   // Tidy up.
@@ -578,17 +1018,24 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  struct sleepq *q = sleepqueue(chan);
+  struct proc *p, **pp;
+
+  acquire(&q->lock);
+  for(pp = &q->head; (p = *pp) != 0; ){
+    // p->chan can't change while p is on the queue.
+    if(p->chan == chan){
+      *pp = p->sqnext;
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+      if(p->state != SLEEPING)
+        panic("wakeup");
+      setrunnable(p);
       release(&p->lock);
+    } else {
+      pp = &p->sqnext;
     }
   }
+  release(&q->lock);
 }
 
 // Kill the process with the given pid.
@@ -599,15 +1046,20 @@ kill(int pid)
 {
   struct proc *p;
 
+  void *chan;
+
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
+      chan = p->state == SLEEPING ? p->chan : 0;
       release(&p->lock);
+      // Wake process from sleep(), and any others on the
+      // same chan, which will just go back to sleep. If p
+      // has woken up meanwhile, it will see p->killed
+      // before it next sleeps.
+      if(chan)
+        wakeup(chan);
       return 0;
     }
     release(&p->lock);
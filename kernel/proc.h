@@ -24,6 +24,12 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation this CPU's TLB is clean for
+  int idle;                   // In wfi; its run queue lock protects this
+  int clockidle;              // Clock interrupts stopped by clockidle()
+  uint64 nclock;              // Clock interrupts taken
+  uint64 ndev;                // Device interrupts taken
+  uint64 nipi;                // Interrupts from other CPUs taken
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,6 +85,19 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A region of user memory whose pages vmfault() fills in
+// from a file the first time they are touched: a segment
+// of the program, or a mapping made by mmap().
+struct vma {
+  uint64 start;                // page-aligned
+  uint64 end;                  // page-aligned, exclusive
+  int perm;                    // PTE_R, PTE_W, PTE_X
+  struct inode *ip;            // where the contents come from; 0 if unused
+  uint off;                    // file offset of start
+  uint filesz;                 // bytes of file data; the rest is zero
+  int flags;                   // MAP_SHARED or MAP_PRIVATE; 0 for exec()
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -91,6 +110,20 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int asid;                    // ASID of user page table; kernel's is asid+1
+  uint64 asidgen;              // Generation of asid; 0 if none
+  int asidcpu;                 // CPU whose TLB entries for asid are current
+  int cpu;                     // CPU whose run queue p goes on when RUNNABLE
+  int nice;                    // Highest priority p runs at; see setnice()
+  int prio;                    // Run queue level, 0 (highest) to NPRIO-1
+  int slice;                   // Ticks used of the time slice at prio
+  uint boostgen;               // Last boost() p was put back up by
+
+  // the lock of the run queue p is on must be held when using this:
+  struct proc *rqnext;         // Next process on the run queue
+
+  // the lock of the sleep queue for chan must be held when using this:
+  struct proc *sqnext;         // Next process sleeping on the same queue
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -98,9 +131,15 @@ struct proc {
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
+  uint64 stackbase;            // Lowest address the user stack can grow to
+  uint64 heapbase;             // Start of sbrk() heap, above the stack
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table, incl. user memory
   struct trapframe *trapframe; // data page for trampoline.S
+  struct usyscall *usyscall;   // read-only page for user code
   struct context context;      // swtch() here to run process
+  struct vma vma[NVMA];        // Demand-paged regions
+  uint64 pinstart, pinend;     // range uvmprefault() keeps resident
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
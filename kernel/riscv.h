@@ -42,6 +42,7 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18) // Supervisor may access User memory
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -97,6 +98,7 @@ w_sie(uint64 x)
 
 // Machine-mode Interrupt Enable
 #define MIE_STIE (1L << 5)  // supervisor timer
+#define MIE_MSIE (1L << 3)  // machine software
 static inline uint64
 r_mie()
 {
@@ -111,6 +113,20 @@ w_mie(uint64 x)
   asm volatile("csrw mie, %0" : : "r" (x));
 }
 
+// Machine-mode interrupt vector
+static inline void 
+w_mtvec(uint64 x)
+{
+  asm volatile("csrw mtvec, %0" : : "r" (x));
+}
+
+// Machine-mode scratch register, for machinevec
+static inline void 
+w_mscratch(uint64 x)
+{
+  asm volatile("csrw mscratch, %0" : : "r" (x));
+}
+
 // supervisor exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
@@ -226,6 +242,10 @@ w_pmpaddr0(uint64 x)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// address-space identifier, bits 44..59 of satp.
+#define SATP_ASID(asid) (((uint64)(asid)) << 44)
+#define MAXASID 0xFFFF
+
 // supervisor address translation and protection;
 // holds the address of the page table.
 static inline void 
@@ -354,6 +374,20 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of address space asid.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
+// flush the TLB entry for virtual address va in address space asid.
+static inline void
+sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -362,10 +396,9 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
 
-#ifdef LAB_PGTBL
-#define SUPERPGSIZE (2 * (1 << 20)) // bytes per page
+#define SUPERPGSIZE (2 * (1 << 20)) // bytes per superpage (level-1 leaf)
 #define SUPERPGROUNDUP(sz)  (((sz)+SUPERPGSIZE-1) & ~(SUPERPGSIZE-1))
-#endif
+#define SUPERPGROUNDDOWN(a) (((a)) & ~(SUPERPGSIZE-1))
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
@@ -375,12 +408,12 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_A (1L << 6) // accessed
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // copy-on-write page (RSW bit, ignored by h/w)
+#define PTE_SWAP (1L << 9) // with PTE_V clear: page is in swap (RSW bit)
 
-
-
-#if defined(LAB_MMAP) || defined(LAB_PGTBL)
 #define PTE_LEAF(pte) (((pte) & PTE_R) | ((pte) & PTE_W) | ((pte) & PTE_X))
-#endif
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -389,6 +422,11 @@ typedef uint64 *pagetable_t; // 512 PTEs
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a swapped-out page's PTE holds its swap slot in place of
+// the physical page number.
+#define SLOT2PTE(slot) (((uint64)(slot)) << 10)
+#define PTE2SLOT(pte) ((int)((pte) >> 10))
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
@@ -0,0 +1,194 @@
+// Slab allocator for small fixed-size kernel objects
+// (pipes, open files, in-memory inodes).
+//
+// Each cache carves whole pages from kalloc() into equal-sized
+// objects. A page ("slab") starts with a struct slab header that
+// records which of its objects are free; a free object's
+// free-list link is kept just past the end of the object, so
+// state set up by the cache's constructor survives being freed.
+// slab_free() finds an object's slab by rounding its address
+// down to the page.
+//
+// Each CPU also keeps a small magazine of free objects, so most
+// allocations and frees take no lock. A CPU moves objects between
+// its magazine and the slabs half a magazine at a time.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slab *next;        // on cache's partial list
+  struct slab *prev;
+  struct slabcache *cache;
+  void *free;               // free objects in this slab
+  int inuse;                // number of objects handed out
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+// link to the next free object, kept after the object itself.
+#define NEXTFREE(c, obj) (*(void**)((char*)(obj) + (c)->size))
+
+struct slabcache *slabcaches;  // every cache, for /meminfo
+
+// Set up cache c for objects of the given size. If ctor is
+// not 0, it is run once on every object when its slab is
+// created; objects must be in that state when freed.
+void
+slabinit(struct slabcache *c, char *name, uint size, void (*ctor)(void*))
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  c->perslab = (PGSIZE - SLABHDR) / (c->size + sizeof(void*));
+  if(c->perslab < 1)
+    panic("slabinit: object too large");
+  c->ctor = ctor;
+  c->partial = 0;
+  c->nempty = 0;
+  c->nslab = 0;
+  c->nalloc = 0;
+  for(int i = 0; i < NCPU; i++)
+    c->mag[i].n = 0;
+  // caches are all set up while booting, on one CPU.
+  c->next = slabcaches;
+  slabcaches = c;
+}
+
+static void
+slab_unlink(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+slab_link(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Allocate a page for a new slab and carve it into objects.
+// Caller must hold c->lock.
+static struct slab*
+newslab(struct slabcache *c)
+{
+  struct slab *s;
+  char *obj;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(int i = c->perslab - 1; i >= 0; i--){
+    obj = (char*)s + SLABHDR + i * (c->size + sizeof(void*));
+    if(c->ctor)
+      c->ctor(obj);
+    NEXTFREE(c, obj) = s->free;
+    s->free = obj;
+  }
+  slab_link(c, s);
+  c->nempty++;
+  c->nslab++;
+  return s;
+}
+
+// Take one object out of c's slabs.
+// Caller must hold c->lock.
+static void*
+getobj(struct slabcache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->partial) == 0 && (s = newslab(c)) == 0)
+    return 0;
+  obj = s->free;
+  s->free = NEXTFREE(c, obj);
+  if(s->inuse++ == 0)
+    c->nempty--;
+  if(s->free == 0)
+    slab_unlink(c, s);
+  c->nalloc++;
+  return obj;
+}
+
+// Return one object to its slab. Keeps at most one
+// completely free slab; gives other free slabs' pages back.
+// Caller must hold c->lock.
+static void
+putobj(struct slabcache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->cache != c)
+    panic("slab_free: wrong cache");
+  if(s->free == 0)
+    slab_link(c, s);
+  NEXTFREE(c, obj) = s->free;
+  s->free = obj;
+  c->nalloc--;
+  if(--s->inuse == 0){
+    if(c->nempty > 0){
+      slab_unlink(c, s);
+      c->nslab--;
+      kfree((void*)s);
+    } else {
+      c->nempty++;
+    }
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if no memory is available.
+void*
+slab_alloc(struct slabcache *c)
+{
+  void *obj = 0;
+  void *o;
+
+  push_off();
+  int n = cpuid();
+  if(c->mag[n].n == 0){
+    // magazine empty: refill half of it from the slabs.
+    acquire(&c->lock);
+    while(c->mag[n].n < MAGSIZE/2 && (o = getobj(c)) != 0)
+      c->mag[n].obj[c->mag[n].n++] = o;
+    release(&c->lock);
+  }
+  if(c->mag[n].n > 0)
+    obj = c->mag[n].obj[--c->mag[n].n];
+  pop_off();
+
+  return obj;
+}
+
+// Free an object that was returned by slab_alloc(c).
+void
+slab_free(struct slabcache *c, void *obj)
+{
+  push_off();
+  int n = cpuid();
+  if(c->mag[n].n == MAGSIZE){
+    // magazine full: give half of it back to the slabs.
+    acquire(&c->lock);
+    while(c->mag[n].n > MAGSIZE/2)
+      putobj(c, c->mag[n].obj[--c->mag[n].n]);
+    release(&c->lock);
+  }
+  c->mag[n].obj[c->mag[n].n++] = obj;
+  pop_off();
+}
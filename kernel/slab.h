@@ -0,0 +1,30 @@
+// Cache of fixed-size kernel objects, packed into pages.
+// See slab.c.
+
+#define MAGSIZE 8  // free objects each CPU keeps on hand
+
+struct slab;
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  struct slabcache *next;   // on the list of all caches
+  uint size;                // object size, rounded up to 8 bytes
+  int perslab;              // objects per slab page
+  void (*ctor)(void*);      // prepares each new object, or 0
+
+  // lock must be held when using these:
+  struct slab *partial;     // slabs with at least one free object
+  int nempty;               // slabs on partial with no objects in use
+  int nslab;                // pages held by this cache
+  int nalloc;               // objects allocated out of slabs
+
+  // each CPU's magazine of free objects; only touched
+  // by that CPU, with interrupts off.
+  struct {
+    int n;
+    void *obj[MAGSIZE];
+  } mag[NCPU];
+};
+
+extern struct slabcache *slabcaches;
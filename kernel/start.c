@@ -6,6 +6,10 @@
 
 void main();
 void timerinit();
+void ipiinit();
+
+// in kernelvec.S, handles machine-mode interrupts.
+void machinevec();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
@@ -40,6 +44,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let other harts interrupt this one.
+  ipiinit();
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -64,3 +71,14 @@ timerinit()
   // ask for the very first timer interrupt.
   w_stimecmp(r_time() + 1000000);
 }
+
+// route machine-mode software interrupts, which other harts
+// send by writing this hart's CLINT MSIP register, to
+// machinevec, which passes them on to supervisor mode.
+void
+ipiinit()
+{
+  w_mscratch(CLINT_MSIP(r_mhartid()));
+  w_mtvec((uint64)machinevec);
+  w_mie(r_mie() | MIE_MSIE);
+}
@@ -0,0 +1,273 @@
+// Swap space, so that processes can use more memory than
+// the machine has.
+//
+// mkfs reserves a swap area at the end of the disk, after
+// the file system (sb.swapstart, sb.nswap), which holds
+// pages of user memory in page-sized slots.
+//
+// When uvmkalloc() can't find a free page, it calls
+// swapout() to evict some. swapout() picks pages with the
+// clock algorithm: a hand sweeps through each process's
+// memory in turn, clearing PTE_A on pages used since it last
+// came by, and evicting the first page it finds with PTE_A
+// still clear. An evicted page's PTE is left invalid, with
+// PTE_SWAP set and the slot number in place of the physical
+// page number; vmfault() reads the page back in when the
+// process next touches it.
+//
+// fork() shares swapped-out pages: each slot counts the
+// PTEs that refer to it. A page stays in memory until it
+// has been written out; a fault on it in the meantime
+// copies it from memory rather than reading the slot early.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "defs.h"
+
+#define MAXSLOT (NSWAP / (PGSIZE / BSIZE))
+
+// pages evicted per swapout(), leaving a little memory
+// spare for page-table pages and the like.
+#define SWAPBATCH 4
+
+// most pages being written out at once.
+#define NWRITING NCPU
+
+// most PTEs one swapout() examines before giving up.
+#define MAXSCAN (2 * (PHYSTOP - KERNBASE) / PGSIZE)
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;
+  uint dev;
+  uint start;                // first block of swap area
+  int nslot;                 // 0 if there's no swap area
+  uchar ref[MAXSLOT];        // PTEs referring to each slot
+  int next;                  // where to look for a free slot
+  struct {
+    int slot;
+    char *pa;                // 0 if this entry is unused
+  } writing[NWRITING];       // pages being written out
+
+  // the clock hand: a process, and an address in it.
+  int hand;
+  uint64 handva;
+
+  uint64 nout;               // pages written out
+  uint64 nin;                // pages read back in
+} swap;
+
+void
+swapinit(uint dev, struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  swap.dev = dev;
+  swap.start = sb->swapstart;
+  swap.nslot = sb->nswap / (PGSIZE / BSIZE);
+  if(swap.nslot > MAXSLOT)
+    swap.nslot = MAXSLOT;
+}
+
+// Is slot being written out? Caller must hold swap.lock.
+static int
+writing(int slot)
+{
+  for(int i = 0; i < NWRITING; i++)
+    if(swap.writing[i].pa && swap.writing[i].slot == slot)
+      return i;
+  return -1;
+}
+
+// Allocate a slot for page pa, with one reference, and note
+// that pa is being written to it.
+// Returns the slot, or -1 if swap is full.
+static int
+swapreserve(char *pa)
+{
+  int i, slot, w;
+
+  acquire(&swap.lock);
+  for(w = 0; w < NWRITING; w++)
+    if(swap.writing[w].pa == 0)
+      break;
+  if(w == NWRITING){
+    release(&swap.lock);
+    return -1;
+  }
+  for(i = 0; i < swap.nslot; i++){
+    slot = (swap.next + i) % swap.nslot;
+    if(swap.ref[slot] == 0 && writing(slot) < 0){
+      swap.ref[slot] = 1;
+      swap.writing[w].slot = slot;
+      swap.writing[w].pa = pa;
+      swap.next = slot + 1;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Another PTE refers to slot, after fork().
+void
+swapdup(int slot)
+{
+  acquire(&swap.lock);
+  if(swap.ref[slot] == 0 || swap.ref[slot] == 255)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE no longer refers to slot.
+void
+swapput(int slot)
+{
+  acquire(&swap.lock);
+  if(swap.ref[slot] == 0)
+    panic("swapput");
+  swap.ref[slot]--;
+  release(&swap.lock);
+}
+
+// Copy the page in slot to mem.
+// Returns 0, or -1 if it would have to sleep with
+// interrupts off.
+int
+swapread(int slot, char *mem)
+{
+  int w;
+
+  acquire(&swap.lock);
+  if((w = writing(slot)) >= 0){
+    memmove(mem, swap.writing[w].pa, PGSIZE);
+    release(&swap.lock);
+    return 0;
+  }
+  release(&swap.lock);
+
+  // see uvmprefault().
+  if(intr_get() == 0)
+    return -1;
+  swap.nin++;
+  virtio_disk_rwpage(swap.start + slot * (PGSIZE / BSIZE), mem, 0);
+  return 0;
+}
+
+// Evict a page of user memory. Returns 0 on success, -1 if
+// nothing could be evicted.
+static int
+swapout1(void)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint64 va, pa;
+  int i, slot, w, budget = MAXSCAN;
+
+  acquire(&swap.lock);
+  i = swap.hand;
+  va = swap.handva;
+  release(&swap.lock);
+
+  for(; budget > 0; i = (i + 1) % NPROC, va = 0){
+    p = &proc[i];
+    acquire(&p->lock);
+    // only take pages from the caller, or from a process
+    // that is asleep, which isn't in the middle of using its
+    // page table: a RUNNABLE one may have been preempted
+    // halfway through fork() or a copy-on-write fault. the
+    // scheduler flushes the TLB before it runs them again.
+    if(p->pagetable == 0 || (p->state != SLEEPING && p != myproc())){
+      release(&p->lock);
+      budget--;
+      continue;
+    }
+    pte = uvmclock(p, &va, &budget);
+    if(p == myproc())
+      sfence_vma();  // so PTE_A gets set again.
+    else
+      p->asidgen = 0;  // its TLB entries are stale; see kvmswitch().
+    if(pte == 0){
+      release(&p->lock);
+      continue;
+    }
+
+    // found one.
+    pa = PTE2PA(*pte);
+    if((slot = swapreserve((char*)pa)) < 0){
+      release(&p->lock);
+      return -1;
+    }
+    *pte = SLOT2PTE(slot) | PTE_SWAP |
+      (PTE_FLAGS(*pte) & ~(PTE_V | PTE_A | PTE_D));
+    if(p == myproc())
+      sfence_vma();
+    release(&p->lock);
+
+    acquire(&swap.lock);
+    swap.hand = i;
+    swap.handva = va + PGSIZE;
+    swap.nout++;
+    release(&swap.lock);
+
+    virtio_disk_rwpage(swap.start + slot * (PGSIZE / BSIZE), (char*)pa, 1);
+
+    acquire(&swap.lock);
+    w = writing(slot);
+    swap.writing[w].pa = 0;
+    release(&swap.lock);
+    kfree((char*)pa);
+    return 0;
+  }
+  return -1;
+}
+
+// Evict some pages of user memory, to make room.
+// Returns the number evicted.
+int
+swapout(void)
+{
+  int n;
+
+  // writing to the disk means sleeping.
+  if(swap.nslot == 0 || intr_get() == 0)
+    return 0;
+  for(n = 0; n < SWAPBATCH; n++)
+    if(swapout1() < 0)
+      break;
+  return n;
+}
+
+// Report slots in use and slots in all, for /meminfo.
+void
+swapusage(int *used, int *total)
+{
+  *used = 0;
+  acquire(&swap.lock);
+  for(int i = 0; i < swap.nslot; i++)
+    if(swap.ref[i])
+      (*used)++;
+  release(&swap.lock);
+  *total = swap.nslot;
+}
+
+// Print swap usage.
+// Runs when user types ^F on console.
+void
+swapdump(void)
+{
+  int used = 0;
+
+  for(int i = 0; i < swap.nslot; i++)
+    if(swap.ref[i])
+      used++;
+  printf("swap: %d of %d slots used, %ld pages out, %ld pages in\n",
+         used, swap.nslot, swap.nout, swap.nin);
+}
@@ -102,6 +102,12 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern uint64 sys_ttyraw(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_pgaccess(void);
+extern uint64 sys_setnice(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -128,6 +134,12 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_ttyraw]  sys_ttyraw,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_spawn]   sys_spawn,
+[SYS_madvise] sys_madvise,
+[SYS_pgaccess] sys_pgaccess,
+[SYS_setnice] sys_setnice,
 };
 
 void
@@ -141,6 +153,7 @@ syscall(void)
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
     p->trapframe->a0 = syscalls[num]();
+    p->pinstart = p->pinend = 0;  // see uvmprefault().
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -20,4 +20,10 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
-#define SYS_ttyraw 22
\ No newline at end of file
+#define SYS_ttyraw 22
+#define SYS_mmap   23
+#define SYS_munmap 24
+#define SYS_spawn  25
+#define SYS_madvise 26
+#define SYS_pgaccess 27
+#define SYS_setnice 28
@@ -179,6 +179,74 @@ sys_ttyraw(void)
   return 0;
 }
 
+// Map part of a file into memory. Pages are read in when
+// first touched; see vmfault().
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len;
+  int prot, flags, off;
+  struct file *f;
+  struct proc *p = myproc();
+  struct vma *v;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  if(argfd(4, 0, &f) < 0)
+    return -1;
+  argint(5, &off);
+
+  if(len == 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(f->type != FD_INODE || !f->readable)
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+  len = PGROUNDUP(len);
+  if(len == 0 || (uint64)off + len > MAXFILE*BSIZE)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return -1;
+  if((addr = vmaplace(addr, len)) == 0)
+    return -1;
+
+  v->start = addr;
+  v->end = addr + len;
+  // there are no write-only pages in RISC-V.
+  v->perm = 0;
+  if(prot & (PROT_READ|PROT_WRITE))
+    v->perm |= PTE_R;
+  if(prot & PROT_WRITE)
+    v->perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    v->perm |= PTE_X;
+  v->ip = idup(f->ip);
+  v->off = off;
+  v->filesz = len;
+  v->flags = flags;
+  return addr;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  if(vmaunmap(addr, len) < 0)
+    return -1;
+  return 0;
+}
+
 // Is the directory dp empty except for "." and ".." ?
 static int
 isdirempty(struct inode *dp)
@@ -441,47 +509,87 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Copy the user argv array at uargv into argv[MAXARG],
+// one kalloc()ed page per string.
+// Caller must freeargv(argv) whether or not this succeeds.
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  argaddr(1, &uargv);
-  if(argstr(0, path, MAXPATH) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(char*));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+}
 
-  int ret = exec(path, argv);
-
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+static void
+freeargv(char **argv)
+{
+  for(int i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret = -1;
 
+  argaddr(1, &uargv);
+  if(argstr(0, path, MAXPATH) < 0) {
+    return -1;
+  }
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(myproc(), path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  int fdmap[NOFILE], nfd, i, ret = -1;
+  uint64 uargv, ufdmap;
+
+  argaddr(1, &uargv);
+  argaddr(2, &ufdmap);
+  argint(3, &nfd);
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  if(ufdmap){
+    if(nfd < 0 || nfd > NOFILE)
+      return -1;
+    if(copyin(myproc()->pagetable, (char*)fdmap, ufdmap, nfd*sizeof(int)) < 0)
+      return -1;
+    for(i = 0; i < nfd; i++){
+      if(fdmap[i] == -1)
+        continue;
+      if(fdmap[i] < 0 || fdmap[i] >= NOFILE || myproc()->ofile[fdmap[i]] == 0)
+        return -1;
+    }
+  }
+  if(fetchargv(uargv, argv) == 0)
+    ret = spawn(path, argv, ufdmap ? fdmap : 0, nfd);
+  freeargv(argv);
+  return ret;
 }
 
 uint64
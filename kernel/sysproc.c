@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "fcntl.h"
 
 uint64
 sys_exit(void)
@@ -48,6 +49,54 @@ sys_sbrk(void)
   return addr;
 }
 
+// Give the pages of heap or stack in [addr, addr+len) back
+// to the kernel. They read as zeroes when next touched.
+uint64
+sys_madvise(void)
+{
+  struct proc *p = myproc();
+  uint64 addr, len;
+  int advice;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &advice);
+  if(advice != MADV_DONTNEED || addr % PGSIZE != 0)
+    return -1;
+  if(addr < p->stackbase || addr > PGROUNDUP(p->sz) ||
+     len > PGROUNDUP(p->sz) - addr)
+    return -1;
+  if(uvmdiscard(p->pagetable, addr, PGROUNDUP(len)) < 0)
+    return -1;
+  return 0;
+}
+
+// Report which of npages pages of user memory at addr have
+// been used since the last pgaccess() of them: bit i of the
+// bitmask at mask is set if page i was, and each page's
+// accessed bit is cleared.
+uint64
+sys_pgaccess(void)
+{
+  struct proc *p = myproc();
+  uint64 addr, mask, bits;
+  int npages, n;
+
+  argaddr(0, &addr);
+  argint(1, &npages);
+  argaddr(2, &mask);
+  addr = PGROUNDDOWN(addr);
+  if(npages < 0 || addr >= USERTOP || npages > (USERTOP - addr) / PGSIZE)
+    return -1;
+  for(int i = 0; i < npages; i += 64){
+    n = npages - i < 64 ? npages - i : 64;
+    bits = uvmaccessed(p->pagetable, addr + (uint64)i*PGSIZE, n);
+    if(copyout(p->pagetable, mask + i/8, (char*)&bits, (n+7)/8) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 uint64
 sys_sleep(void)
 {
@@ -57,6 +106,7 @@ sys_sleep(void)
   argint(0, &n);
   if(n < 0)
     n = 0;
+  settime();
   acquire(&tickslock);
   ticks0 = ticks;
   while(ticks - ticks0 < n){
@@ -64,6 +114,7 @@ sys_sleep(void)
       release(&tickslock);
       return -1;
     }
+    wakeat(ticks0 + n);
     sleep(&ticks, &tickslock);
   }
   release(&tickslock);
@@ -79,6 +130,18 @@ sys_kill(void)
   return kill(pid);
 }
 
+// set a process's scheduling nice level; see setnice().
+// returns the old level.
+uint64
+sys_setnice(void)
+{
+  int pid, nice;
+
+  argint(0, &pid);
+  argint(1, &nice);
+  return setnice(pid, nice);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
@@ -86,6 +149,7 @@ sys_uptime(void)
 {
   uint xticks;
 
+  settime();
   acquire(&tickslock);
   xticks = ticks;
   release(&tickslock);
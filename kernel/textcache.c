@@ -0,0 +1,197 @@
+// Cache of read-only program pages, shared by every process
+// that runs the same binary.
+//
+// exec() leaves a program's segments to be read in by
+// vmfault(). For segments without write permission, vmfault()
+// asks textpage() for the page, which returns the cached copy
+// if some process has already read it in, so repeated execs
+// of a program (xargs running echo, say) share one copy of
+// its text and don't go to the disk for it again.
+//
+// Pages are identified by (dev, inum, file offset, bytes
+// of file data in the page). The cache holds one reference
+// to each page; each page table that maps it holds another.
+// Writing or truncating a file drops its pages from the
+// cache (processes already mapping them keep the old
+// contents). When memory for user pages runs out,
+// textreclaim() frees cached pages that no process maps.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
+#include "defs.h"
+
+#define NTEXTHASH 61
+
+struct textpage {
+  uint dev;
+  uint inum;
+  uint off;                 // file offset of the page's data
+  uint n;                   // bytes of file data; the rest is zero
+  char *pa;
+  struct textpage *next;    // in hash bucket
+};
+
+struct {
+  struct spinlock lock;
+  struct textpage *bucket[NTEXTHASH];
+  struct slabcache cache;
+  int npage;
+} text;
+
+void
+textinit(void)
+{
+  initlock(&text.lock, "text");
+  slabinit(&text.cache, "textpage", sizeof(struct textpage), 0);
+}
+
+static struct textpage**
+textbucket(uint dev, uint inum)
+{
+  return &text.bucket[(dev * 31 + inum) % NTEXTHASH];
+}
+
+// Look for a cached page. Caller must hold text.lock.
+static struct textpage*
+textlookup(uint dev, uint inum, uint off, uint n)
+{
+  struct textpage *t;
+
+  for(t = *textbucket(dev, inum); t; t = t->next)
+    if(t->dev == dev && t->inum == inum && t->off == off && t->n == n)
+      return t;
+  return 0;
+}
+
+// Return a page holding n bytes of ip's data from offset off,
+// followed by zeroes, with a reference for the caller to map
+// read-only. Reads the data in if it isn't cached yet; data
+// past the end of the file reads as zeroes.
+// Returns 0 if out of memory or the read fails.
+char*
+textpage(struct inode *ip, uint off, uint n)
+{
+  struct textpage *t;
+  char *mem;
+
+  acquire(&text.lock);
+  if((t = textlookup(ip->dev, ip->inum, off, n)) != 0){
+    kaddref(t->pa);
+    release(&text.lock);
+    return t->pa;
+  }
+  release(&text.lock);
+
+  if((t = slab_alloc(&text.cache)) == 0)
+    return 0;
+  if((mem = kalloc_zeroed()) == 0 && (textreclaim() == 0 || (mem = kalloc_zeroed()) == 0)){
+    slab_free(&text.cache, t);
+    return 0;
+  }
+
+  // hold ip's lock until the page is in the cache, so
+  // that a write to the file can't slip in between
+  // reading the page and caching it.
+  ilock(ip);
+  if(readi(ip, 0, (uint64)mem, off, n) < 0){
+    iunlock(ip);
+    kfree(mem);
+    slab_free(&text.cache, t);
+    return 0;
+  }
+  acquire(&text.lock);
+  struct textpage *t1 = textlookup(ip->dev, ip->inum, off, n);
+  if(t1){
+    // another process read it in first.
+    kaddref(t1->pa);
+    release(&text.lock);
+    iunlock(ip);
+    kfree(mem);
+    slab_free(&text.cache, t);
+    return t1->pa;
+  }
+  t->dev = ip->dev;
+  t->inum = ip->inum;
+  t->off = off;
+  t->n = n;
+  t->pa = mem;
+  t->next = *textbucket(ip->dev, ip->inum);
+  *textbucket(ip->dev, ip->inum) = t;
+  text.npage++;
+  kaddref(mem);
+  release(&text.lock);
+  iunlock(ip);
+  return mem;
+}
+
+// ip's contents are about to change; forget its pages.
+// Caller must hold ip's lock.
+void
+textinval(struct inode *ip)
+{
+  struct textpage **pp, *t, *dead = 0;
+
+  acquire(&text.lock);
+  for(pp = textbucket(ip->dev, ip->inum); (t = *pp) != 0; ){
+    if(t->dev == ip->dev && t->inum == ip->inum){
+      *pp = t->next;
+      t->next = dead;
+      dead = t;
+      text.npage--;
+    } else {
+      pp = &t->next;
+    }
+  }
+  release(&text.lock);
+
+  while((t = dead) != 0){
+    dead = t->next;
+    kfree(t->pa);
+    slab_free(&text.cache, t);
+  }
+}
+
+// Free cached pages that no process maps any more.
+// Returns the number of pages freed.
+int
+textreclaim(void)
+{
+  struct textpage **pp, *t, *dead = 0;
+  int n = 0;
+
+  acquire(&text.lock);
+  for(int i = 0; i < NTEXTHASH; i++){
+    for(pp = &text.bucket[i]; (t = *pp) != 0; ){
+      if(krefcnt(t->pa) == 1){
+        *pp = t->next;
+        t->next = dead;
+        dead = t;
+        text.npage--;
+        n++;
+      } else {
+        pp = &t->next;
+      }
+    }
+  }
+  release(&text.lock);
+
+  while((t = dead) != 0){
+    dead = t->next;
+    kfree(t->pa);
+    slab_free(&text.cache, t);
+  }
+  return n;
+}
+
+// Return the number of pages in the cache, for /meminfo.
+int
+textpages(void)
+{
+  return text.npage;
+}
@@ -6,20 +6,35 @@
 #include "proc.h"
 #include "defs.h"
 
+// ticks counts tenths of a second of the time CSR, rather
+// than clock interrupts, so that it stays right while CPUs
+// are idle. A CPU running a process takes a clock interrupt
+// at the start of each tick, to preempt it; an idle CPU only
+// takes one when the next sleep() is due (see clockidle()).
+#define TICKTIME 1000000  // time CSR cycles per tick
+
 struct spinlock tickslock;
 uint ticks;
+uint nextwake = -1;       // first tick a sleep() waits for; see wakeat()
+struct ushared *ushared;  // mapped read-only at USHARED in every process
 
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
 
+// in uaccess.S.
+extern char uaccess_start[], uaccess_end[], uaccess_fault[];
+
 extern int devintr();
 
 void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  if((ushared = (struct ushared*)kalloc()) == 0)
+    panic("trapinit");
+  memset(ushared, 0, PGSIZE);
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -45,6 +60,9 @@ usertrap(void)
   // since we're now in the kernel.
   w_stvec((uint64)kernelvec);
 
+  // the kernel touches user memory only in uaccess.S.
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+
   struct proc *p = myproc();
   
   // save user program counter.
@@ -65,6 +83,22 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault, perhaps on a page that isn't ready yet.
+    // vmfault() may have to read the page from disk, so
+    // turn on interrupts, as for a system call, once done
+    // with the trap registers.
+    uint64 scause = r_scause();
+    uint64 va = r_stval();
+    int access = scause == 12 ? PTE_X : (scause == 13 ? PTE_R : PTE_W);
+
+    intr_on();
+
+    if(vmfault(p->pagetable, va, access) != 0){
+      printf("usertrap(): unexpected scause 0x%lx pid=%d\n", scause, p->pid);
+      printf("            sepc=0x%lx stval=0x%lx\n", p->trapframe->epc, va);
+      setkilled(p);
+    }
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -76,9 +110,9 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    preempt();
 
   usertrapret();
 }
@@ -120,7 +154,7 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
 
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -144,36 +178,126 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+  // a trap in the middle of a uaccess.S copy comes with SUM
+  // set. turn it off before vmfault() or preempt() can switch
+  // to another process; restoring sstatus turns it back on.
+  w_sstatus(sstatus & ~SSTATUS_SUM);
+
+  if((scause == 13 || scause == 15) && myproc() != 0 &&
+     sepc >= (uint64)uaccess_start && sepc < (uint64)uaccess_end){
+    // a page fault copying to or from user memory.
+    // fix the page up as usertrap() would, then retry;
+    // or, if the address is bad, make the copy return -1.
+    // vmfault() may have to sleep, which is all right
+    // if the copy ran with interrupts on.
+    uint64 va = r_stval();
+    if(sstatus & SSTATUS_SPIE)
+      intr_on();
+    if(vmfault(myproc()->pagetable, va, scause == 13 ? PTE_R : PTE_W) != 0)
+      sepc = (uint64)uaccess_fault;
+    intr_off();
+    w_sepc(sepc);
+    w_sstatus(sstatus);
+    return;
+  }
+
   if((which_dev = devintr()) == 0){
     // interrupt or trap from an unknown source
     printf("scause=0x%lx sepc=0x%lx stval=0x%lx\n", scause, r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // maybe give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0)
-    yield();
+    preempt();
 
-  // the yield() may have caused some traps to occur,
+  // the preempt() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
   w_sepc(sepc);
   w_sstatus(sstatus);
 }
 
+// Have the clock wake sleepers on &ticks at tick t.
+// Caller must hold tickslock.
 void
-clockintr()
+wakeat(uint t)
+{
+  if(t < nextwake)
+    nextwake = t;
+}
+
+// Bring ticks up to date, and wake sleepers that are due.
+// Called on clock interrupts, by scheduler() when an idle
+// CPU wakes, and by sys_sleep() and sys_uptime(), since ticks
+// doesn't move while every CPU is idle, which can be for ever.
+void
+settime(void)
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
+  uint now = r_time() / TICKTIME;
+  int boosttime = 0;
+
+  // a quick look without the lock; the clocks of CPUs that
+  // are running processes all interrupt at the same time.
+  if(now == ticks)
+    return;
+  acquire(&tickslock);
+  if(now != ticks){
+    boosttime = now / BOOSTTICKS != ticks / BOOSTTICKS;
+    ticks = now;
+    ushared->ticks = ticks;
+    if(ticks >= nextwake){
+      nextwake = -1;
+      wakeup(&ticks);
+    }
   }
+  release(&tickslock);
+  if(boosttime)
+    boost();
+}
 
-  // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+// Ask for this CPU's next timer interrupt at the start of
+// the next tick. This also clears the interrupt request.
+// Interrupts must be off.
+void
+clocktick(void)
+{
+  mycpu()->clockidle = 0;
+  w_stimecmp((r_time() / TICKTIME + 1) * TICKTIME);
+}
+
+// Ask for this CPU's next timer interrupt when the next
+// sleep() is due, if any, for a CPU with nothing to run.
+// Other CPUs send it an IPI if they have work for it.
+// Interrupts must be off.
+void
+clockidle(void)
+{
+  mycpu()->clockidle = 1;
+  if(nextwake == -1)
+    w_stimecmp(-1);
+  else
+    w_stimecmp((uint64)nextwake * TICKTIME);
+}
+
+void
+clockintr()
+{
+  settime();
+  if(mycpu()->proc)
+    clocktick();
+  else
+    clockidle();
+}
+
+// Print each CPU's interrupt counts.
+// Runs when user types ^P on console.
+void
+intrdump(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    if(cpus[i].nclock)
+      printf("cpu %d: %ld clock interrupts, %ld device interrupts, %ld IPIs\n",
+             i, cpus[i].nclock, cpus[i].ndev, cpus[i].nipi);
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -206,11 +330,20 @@ devintr()
     if(irq)
       plic_complete(irq);
 
+    mycpu()->ndev++;
     return 1;
   } else if(scause == 0x8000000000000005L){
     // timer interrupt.
+    mycpu()->nclock++;
     clockintr();
     return 2;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt from another hart, passed on by
+    // machinevec in kernelvec.S, to get this one out of wfi
+    // in scheduler(). clear SSIP.
+    w_sip(r_sip() & ~2);
+    mycpu()->nipi++;
+    return 1;
   } else {
     return 0;
   }
@@ -46,7 +46,7 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    int *busy;   // set to 0 when the operation finishes
     char status;
   } info[NUM];
 
@@ -212,11 +212,12 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Read or write len bytes at data, starting at the given
+// sector, and wait for the disk to finish. *busy is set while
+// the disk owns the data; the caller sleeps on busy.
+static void
+disk_rw(uint64 sector, void *data, uint len, int write, int *busy)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
@@ -249,12 +250,12 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
+  disk.desc[idx[1]].addr = (uint64) data;
+  disk.desc[idx[1]].len = len;
   if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
+    disk.desc[idx[1]].flags = 0; // device reads data
   else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes data
   disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
   disk.desc[idx[1]].next = idx[2];
 
@@ -264,9 +265,9 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
   disk.desc[idx[2]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the busy flag for virtio_disk_intr().
+  *busy = 1;
+  disk.info[idx[0]].busy = busy;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -281,16 +282,32 @@ virtio_disk_rw(struct buf *b, int write)
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(*busy == 1) {
+    sleep(busy, &disk.vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
+  disk.info[idx[0]].busy = 0;
   free_chain(idx[0]);
 
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  disk_rw(b->blockno * (BSIZE / 512), b->data, BSIZE, write, &b->disk);
+}
+
+// Read or write a whole page, starting at block blockno,
+// without going through the buffer cache. Used for swap.
+void
+virtio_disk_rwpage(uint blockno, void *pa, int write)
+{
+  int busy;
+
+  disk_rw(blockno * (BSIZE / 512), pa, PGSIZE, write, &busy);
+}
+
 void
 virtio_disk_intr()
 {
@@ -316,9 +333,9 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    int *busy = disk.info[id].busy;
+    *busy = 0;   // disk is done with the data
+    wakeup(busy);
 
     disk.used_idx += 1;
   }
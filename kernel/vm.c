@@ -3,8 +3,13 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
 
 /*
  * the kernel's page table.
@@ -15,6 +20,62 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// uaccess.S
+extern int copyuser(void*, const void*, uint64);
+extern int copyuserstr(char*, const char*, uint64);
+
+#define SUPERORDER 9  // a superpage is 2^SUPERORDER pages
+
+// Page-table pages are recycled through a small cache of
+// zeroed pages on each CPU, so that the page tables that
+// every fork() builds and every exit() tears down don't each
+// go through kfree() and kalloc(), which fill the page with
+// junk, and then a memset() back to zero. freewalk() clears
+// each page as it goes, so a freed page-table page is
+// already zero. A CPU's cache is only touched by that CPU,
+// with interrupts off.
+#define PTCACHEMAX 32
+
+struct {
+  pagetable_t page[PTCACHEMAX];
+  int n;
+  uint64 hit;     // ptalloc()s served from the cache
+  uint64 miss;    // ptalloc()s that had to kalloc() and zero
+  uint64 keep;    // ptfree()s kept in the cache
+  uint64 spill;   // ptfree()s passed on to kfree()
+} ptcache[NCPU];
+
+int ptlive;       // page-table pages in use, for /meminfo
+
+static pagetable_t ptalloc(void);
+static void ptfree(pagetable_t);
+
+// Address-space identifiers (ASIDs) tag TLB entries with the
+// page table they came from, so that switching page tables
+// needn't flush the TLB. Each process has a pair: asid for its
+// user page table and asid+1 for its kernel page table. ASID 0
+// is the kernel's own page table, which the scheduler runs on.
+//
+// ASIDs are handed out in order, and never reused within a
+// generation. When they run out, a new generation starts, and
+// each CPU flushes its whole TLB before running a process
+// with an ASID of the new generation; a process whose ASIDs
+// are from an old generation gets new ones when it next runs.
+//
+// A process that changes its own page table flushes the
+// entries on the CPU it's running on (see uvmflush()); entries
+// on CPUs it ran on earlier are flushed if it runs there
+// again (see kvmswitch()). Changes to another process's page
+// table (by swapout()) take away its ASIDs instead.
+#define FLUSHMAX 32   // flush whole ASID when unmapping more pages
+
+struct {
+  struct spinlock lock;
+  int max;        // largest ASID the hardware supports
+  int next;       // next to hand out
+  uint64 gen;     // current generation; never 0
+} asids;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -33,6 +94,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
+  // CLINT MSIP registers, for interrupting other harts
+  kvmmap(kpgtbl, KCLINT, CLINT, PGSIZE, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -70,9 +134,197 @@ kvminithart()
   sfence_vma();
 }
 
+// Find out how many ASIDs the hardware has, by writing ones
+// to the field in satp and seeing which stick.
+void
+asidinit(void)
+{
+  initlock(&asids.lock, "asid");
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(MAXASID));
+  asids.max = (r_satp() >> 44) & MAXASID;
+  w_satp(MAKE_SATP(kernel_pagetable));
+  sfence_vma();
+  asids.next = 2;
+  asids.gen = 1;
+}
+
+// Switch this CPU to process p's kernel page table, or to the
+// kernel's own if p is 0, for the scheduler. Gives p ASIDs of
+// the current generation if it doesn't have them, and flushes
+// TLB entries that might be stale.
+// Caller must hold p->lock.
+void
+kvmswitch(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 gen;
+
+  if(p == 0){
+    w_satp(MAKE_SATP(kernel_pagetable));
+    return;
+  }
+
+  acquire(&asids.lock);
+  if(p->asidgen != asids.gen){
+    if(asids.next + 1 > asids.max){
+      // out of ASIDs. if there are none at all, this
+      // happens on every switch, and every switch flushes.
+      asids.gen++;
+      asids.next = 2;
+    }
+    p->asid = asids.next;
+    p->asidgen = asids.gen;
+    p->asidcpu = id;  // nothing cached for a new ASID.
+    asids.next += 2;
+  }
+  gen = asids.gen;
+  release(&asids.lock);
+
+  w_satp(MAKE_SATP(p->kpagetable) | SATP_ASID(p->asid + 1));
+  if(c->asidgen != gen){
+    sfence_vma();
+    c->asidgen = gen;
+  } else if(p->asidcpu != id){
+    // p may have changed its page table on another CPU
+    // since it last ran here.
+    sfence_vma_asid(p->asid);
+    sfence_vma_asid(p->asid + 1);
+  }
+  p->asidcpu = id;
+}
+
+// Each process runs in the kernel on a page table of its own,
+// which maps its user memory as well as the kernel, so that
+// copyin() and copyout() can use user addresses directly.
+//
+// User memory is below USERTOP, in the first 1GB of virtual
+// addresses (level-2 PTE 0). The kernel maps nothing there
+// but devices, all at USERTOP and above. So every user page
+// table's level-1 page for that 1GB holds copies of the
+// kernel's device PTEs (see uvmcreate()), and a process's
+// kernel page table is a copy of the kernel's level-2 page
+// whose PTE 0 points to that level-1 page instead. Changes
+// to the user page table show up in both.
+
+// Create the kernel page table for a process with user page
+// table pagetable. Returns 0 if out of memory.
+pagetable_t
+kvmcreate(pagetable_t pagetable)
+{
+  pagetable_t kpgtbl;
+
+  if((kpgtbl = ptalloc()) == 0)
+    return 0;
+  memmove(kpgtbl, kernel_pagetable, PGSIZE);
+  kvmsetuser(kpgtbl, pagetable);
+  return kpgtbl;
+}
+
+// Free a kernel page table from kvmcreate().
+void
+kvmfree(pagetable_t kpgtbl)
+{
+  memset(kpgtbl, 0, PGSIZE);
+  ptfree(kpgtbl);
+}
+
+// Point kernel page table kpgtbl at the user memory of a
+// new user page table, after exec().
+void
+kvmsetuser(pagetable_t kpgtbl, pagetable_t pagetable)
+{
+  kpgtbl[0] = pagetable[0];
+}
+
+// Allocate a zeroed page-table page.
+// Returns 0 if out of memory.
+static pagetable_t
+ptalloc(void)
+{
+  pagetable_t pt = 0;
+
+  push_off();
+  int id = cpuid();
+  if(ptcache[id].n > 0){
+    pt = ptcache[id].page[--ptcache[id].n];
+    ptcache[id].hit++;
+  } else {
+    ptcache[id].miss++;
+  }
+  pop_off();
+
+  if(pt == 0)
+    pt = kalloc_zeroed();
+  if(pt)
+    __sync_fetch_and_add(&ptlive, 1);
+  return pt;
+}
+
+// Free a page-table page from ptalloc(), which must now be
+// all zeroes.
+static void
+ptfree(pagetable_t pt)
+{
+  push_off();
+  int id = cpuid();
+  if(ptcache[id].n < PTCACHEMAX){
+    ptcache[id].page[ptcache[id].n++] = pt;
+    ptcache[id].keep++;
+    pt = 0;
+  } else {
+    ptcache[id].spill++;
+  }
+  pop_off();
+
+  __sync_fetch_and_sub(&ptlive, 1);
+  if(pt)
+    kfree((void*)pt);
+}
+
+// Print the page-table page cache counters.
+// Runs when user types ^F on console.
+void
+ptcachedump(void)
+{
+  uint64 hit = 0, miss = 0, keep = 0, spill = 0;
+  int cached = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    cached += ptcache[i].n;
+    hit += ptcache[i].hit;
+    miss += ptcache[i].miss;
+    keep += ptcache[i].keep;
+    spill += ptcache[i].spill;
+  }
+  printf("page-table pages: %d cached, %ld allocs from cache, %ld zeroed, "
+         "%ld frees to cache, %ld to kfree\n", cached, hit, miss, keep, spill);
+}
+
+// Replace the 2MB superpage mapped by level-1 PTE *pte with
+// a page-table page of 512 4KB PTEs mapping the same memory.
+// Returns 0 on success, -1 if out of memory.
+static int
+split(pte_t *pte)
+{
+  pagetable_t pt;
+  uint64 pa = PTE2PA(*pte);
+
+  if((pt = ptalloc()) == 0)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | PTE_FLAGS(*pte);
+  *pte = PA2PTE(pt) | PTE_V;
+  sfence_vma();
+  return 0;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
+// If va lies in a 2MB superpage, the superpage is first
+// split into 4KB pages; returns 0 if that runs out of memory.
+// Callers that can deal with superpages use superpte() first.
 //
 // The risc-v Sv39 scheme has three levels of page-table
 // pages. A page-table page contains 512 64-bit PTEs.
@@ -91,17 +343,57 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte) && (level != 1 || split(pte) != 0))
+        return 0;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = ptalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// If va lies in a 2MB superpage, return its level-1 leaf PTE.
+// Otherwise return 0.
+static pte_t*
+superpte(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    return 0;
+  pte = &pagetable[PX(2, va)];
+  if((*pte & PTE_V) == 0 || PTE_LEAF(*pte))
+    return 0;
+  pte = &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+  if((*pte & PTE_V) == 0 || PTE_LEAF(*pte) == 0)
+    return 0;
+  return pte;
+}
+
+// Find the leaf PTE that maps va, without splitting a
+// superpage, and set *pa to the physical address of the 4KB
+// page holding va. Returns 0 if there's no valid mapping.
+static pte_t*
+lookup(pagetable_t pagetable, uint64 va, uint64 *pa)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    return 0;
+  if((pte = superpte(pagetable, va)) != 0){
+    *pa = PTE2PA(*pte) + (PGROUNDDOWN(va) & (SUPERPGSIZE-1));
+    return pte;
+  }
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0)
+    return 0;
+  *pa = PTE2PA(*pte);
+  return pte;
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -111,28 +403,74 @@ walkaddr(pagetable_t pagetable, uint64 va)
   pte_t *pte;
   uint64 pa;
 
-  if(va >= MAXVA)
-    return 0;
-
-  pte = walk(pagetable, va, 0);
-  if(pte == 0)
-    return 0;
-  if((*pte & PTE_V) == 0)
+  if((pte = lookup(pagetable, va, &pa)) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
   return pa;
 }
 
 // add a mapping to the kernel page table.
+// uses 2MB superpages for the parts of the range where
+// va and pa are both 2MB-aligned, saving page-table pages
+// and TLB entries for the direct map of RAM.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 n;
+
+  while(sz > 0){
+    if(va % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 && sz >= SUPERPGSIZE){
+      n = SUPERPGROUNDDOWN(sz);
+      if(mapsuper(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    } else {
+      n = SUPERPGROUNDUP(va + 1) - va;
+      if(n > sz || va % SUPERPGSIZE != pa % SUPERPGSIZE)
+        n = sz;
+      if(mappages(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    }
+    va += n;
+    pa += n;
+    sz -= n;
+  }
+}
+
+// Create 2MB superpage PTEs (level-1 leaves) for virtual
+// addresses starting at va that refer to physical addresses
+// starting at pa. va, pa and size must be 2MB-aligned.
+// Returns 0 on success, -1 if a page-table page couldn't
+// be allocated.
+int
+mapsuper(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a;
+  pte_t *pte;
+  pagetable_t l1;
+
+  if(va % SUPERPGSIZE != 0 || pa % SUPERPGSIZE != 0 || size % SUPERPGSIZE != 0)
+    panic("mapsuper: not aligned");
+
+  for(a = va; a < va + size; a += SUPERPGSIZE, pa += SUPERPGSIZE){
+    pte = &pagetable[PX(2, a)];
+    if(*pte & PTE_V){
+      if(PTE_LEAF(*pte))
+        panic("mapsuper: remap");
+      l1 = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if((l1 = ptalloc()) == 0)
+        return -1;
+      *pte = PA2PTE(l1) | PTE_V;
+    }
+    pte = &l1[PX(1, a)];
+    if(*pte & PTE_V)
+      panic("mapsuper: remap");
+    *pte = PA2PTE(pa) | perm | PTE_V;
+  }
+  return 0;
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -171,8 +509,31 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Flush this CPU's TLB entries for npages of user memory at
+// va, after a change to their PTEs in pagetable, if that's the
+// current process's. See the comment above asids.
+static void
+uvmflush(pagetable_t pagetable, uint64 va, uint64 npages)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || pagetable != p->pagetable)
+    return;
+  if(npages > FLUSHMAX){
+    sfence_vma_asid(p->asid);
+    sfence_vma_asid(p->asid + 1);
+    return;
+  }
+  for(; npages > 0; npages--, va += PGSIZE){
+    sfence_vma_page(va, p->asid);
+    sfence_vma_page(va, p->asid + 1);
+  }
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Heap pages that were never touched have no
+// mapping and are skipped. A 2MB superpage must be removed
+// all at once (see uvmdealloc()).
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -184,10 +545,29 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+    if((pte = superpte(pagetable, a)) != 0){
+      if(a % SUPERPGSIZE != 0 || a + SUPERPGSIZE > va + npages*PGSIZE)
+        panic("uvmunmap: part of a superpage");
+      // its pages are reference-counted one by one.
+      for(int i = 0; do_free && i < SUPERPGSIZE/PGSIZE; i++)
+        kfree((void*)(PTE2PA(*pte) + i*PGSIZE));
+      *pte = 0;
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if((pte = walk(pagetable, a, 0)) == 0){
+      // no page-table page, so nothing is mapped in the rest
+      // of this 2MB region.
+      a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_SWAP){
+      swapput(PTE2SLOT(*pte));
+      *pte = 0;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -196,18 +576,28 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     }
     *pte = 0;
   }
+  uvmflush(pagetable, va, npages);
 }
 
-// create an empty user page table.
+// create an empty user page table, with the kernel's device
+// mappings above USERTOP (see kvmcreate()).
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
-  pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable_t pagetable, l1, kl1;
+
+  pagetable = ptalloc();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
+  if((l1 = ptalloc()) == 0){
+    ptfree(pagetable);
+    return 0;
+  }
+  kl1 = (pagetable_t) PTE2PA(kernel_pagetable[0]);
+  for(int i = PX(1, USERTOP); i < 512; i++)
+    l1[i] = kl1[i];
+  pagetable[0] = PA2PTE(l1) | PTE_V;
   return pagetable;
 }
 
@@ -240,12 +630,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -258,7 +647,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or oldsz if
+// out of memory splitting a superpage.
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
@@ -266,6 +656,10 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
+    // split a superpage that would be only partly freed.
+    pte_t *pte = superpte(pagetable, PGROUNDUP(newsz));
+    if(pte && PGROUNDUP(newsz) % SUPERPGSIZE != 0 && split(pte) != 0)
+      return oldsz;
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
     uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
@@ -273,8 +667,50 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   return newsz;
 }
 
+// Unmap and free the user pages in [va, va+len), both
+// page-aligned, for madvise(). Splits any superpage that is
+// only partly freed. Returns 0, or -1 if out of memory
+// splitting a superpage.
+int
+uvmdiscard(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  uint64 ends[2] = { va, va + len };
+  pte_t *pte;
+
+  for(int i = 0; i < 2; i++){
+    pte = superpte(pagetable, ends[i]);
+    if(pte && ends[i] % SUPERPGSIZE != 0 && split(pte) != 0)
+      return -1;
+  }
+  uvmunmap(pagetable, va, len / PGSIZE, 1);
+  return 0;
+}
+
+// Return a bitmask of which of the npages (at most 64) user
+// pages at va have PTE_A set, and clear it, for pgaccess().
+// A superpage's accessed bit covers each of its 4KB pages.
+uint64
+uvmaccessed(pagetable_t pagetable, uint64 va, int npages)
+{
+  pte_t *pte[64];
+  uint64 bits = 0, pa;
+
+  for(int i = 0; i < npages; i++){
+    pte[i] = lookup(pagetable, va + i*PGSIZE, &pa);
+    if(pte[i] && (*pte[i] & PTE_U) && (*pte[i] & PTE_A))
+      bits |= 1L << i;
+  }
+  // only now, so that each page of a superpage sees PTE_A.
+  for(int i = 0; i < npages; i++)
+    if(bits & (1L << i))
+      *pte[i] &= ~PTE_A;
+  uvmflush(pagetable, va, npages);
+  return bits;
+}
+
 // Recursively free page-table pages.
 // All leaf mappings must already have been removed.
+// Zeroes each page on the way, for ptfree().
 void
 freewalk(pagetable_t pagetable)
 {
@@ -285,12 +721,12 @@ freewalk(pagetable_t pagetable)
       // this PTE points to a lower-level page table.
       uint64 child = PTE2PA(pte);
       freewalk((pagetable_t)child);
-      pagetable[i] = 0;
     } else if(pte & PTE_V){
       panic("freewalk: leaf");
     }
+    pagetable[i] = 0;
   }
-  kfree((void*)pagetable);
+  ptfree(pagetable);
 }
 
 // Free user memory pages,
@@ -298,78 +734,676 @@ freewalk(pagetable_t pagetable)
 void
 uvmfree(pagetable_t pagetable, uint64 sz)
 {
+  pagetable_t l1;
+
   if(sz > 0)
     uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+  // the device mappings belong to the kernel's page table.
+  l1 = (pagetable_t) PTE2PA(pagetable[0]);
+  for(int i = PX(1, USERTOP); i < 512; i++)
+    l1[i] = 0;
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Count the pages of user memory that pagetable has resident,
+// for /meminfo. Shared pages count in each process.
+int
+uvmrss(pagetable_t pagetable)
+{
+  pagetable_t l1, l0;
+  int n = 0;
+
+  l1 = (pagetable_t) PTE2PA(pagetable[0]);
+  for(int i = 0; i < PX(1, USERTOP); i++){
+    if((l1[i] & PTE_V) == 0)
+      continue;
+    if(PTE_LEAF(l1[i])){
+      if(l1[i] & PTE_U)
+        n += SUPERPGSIZE / PGSIZE;
+      continue;
+    }
+    l0 = (pagetable_t) PTE2PA(l1[i]);
+    for(int j = 0; j < 512; j++)
+      if((l0[j] & (PTE_V | PTE_U)) == (PTE_V | PTE_U))
+        n++;
+  }
+  return n;
+}
+
+// Make new map the pages that old maps in [start, end), and
+// take a reference to each. If cow is set, writable pages
+// become read-only and PTE_COW in both page tables.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
-int
-uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+static int
+copyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int cow)
 {
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+  for(i = start; i < end; i += PGSIZE){
+    if((pte = superpte(old, i)) != 0){
+      // share the whole superpage.
+      if(cow && (*pte & PTE_W))
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+      pa = PTE2PA(*pte);
+      if(mapsuper(new, i, SUPERPGSIZE, pa, PTE_FLAGS(*pte)) != 0)
+        goto err;
+      for(int j = 0; j < SUPERPGSIZE/PGSIZE; j++)
+        kaddref((void*)(pa + j*PGSIZE));
+      i += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if((pte = walk(old, i, 0)) == 0){
+      i = SUPERPGROUNDDOWN(i) + SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_SWAP){
+      // the child shares the swap slot; each reads in its
+      // own copy.
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      *npte = *pte;
+      swapdup(PTE2SLOT(*pte));
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;  // not touched yet; the child will fault it in.
+    if(cow && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    kaddref((void*)pa);
   }
+  // the parent's mappings may have lost PTE_W.
+  uvmflush(old, start, (end - start) / PGSIZE);
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
+  uvmflush(old, start, (i - start) / PGSIZE);
   return -1;
 }
 
-// mark a PTE invalid for user access.
-// used by exec for the user stack guard page.
-void
-uvmclear(pagetable_t pagetable, uint64 va)
+// Given a parent process's page table, make a child's
+// page table share its memory copy-on-write. Writable pages
+// become read-only and PTE_COW in both page tables, and
+// vmfault() gives a process its own copy when it writes one.
+// Only the page table is copied, so fork's cost depends on
+// the number of pages, not their contents.
+// returns 0 on success, -1 on failure.
+// frees any allocated pages on failure.
+int
+uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  return copyrange(old, new, 0, sz, 1);
+}
+
+// Copy the pages of a parent's mmap()ed regions vma[] to a
+// child's page table, for fork(). MAP_SHARED pages stay
+// shared, if vmaprefault() has read them all in first;
+// MAP_PRIVATE ones become copy-on-write.
+// returns 0 on success, -1 on failure.
+// frees any allocated pages on failure.
+int
+vmacopy(pagetable_t old, pagetable_t new, struct vma *vma)
 {
+  struct vma *v;
+
+  for(int i = 0; i < NVMA; i++){
+    v = &vma[i];
+    if(v->ip == 0 || v->flags == 0)
+      continue;
+    if(copyrange(old, new, v->start, v->end, v->flags & MAP_PRIVATE) != 0){
+      while(--i >= 0){
+        v = &vma[i];
+        if(v->ip && v->flags)
+          uvmunmap(new, v->start, (v->end - v->start) / PGSIZE, 1);
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Read in every page of the current process's MAP_SHARED
+// regions, before fork() calls vmacopy() with a spinlock held.
+// A page that was read in later would be a separate copy in
+// parent and child, and each would write its copy back over
+// the other's. Returns 0, or -1 if a page can't be read in.
+int
+vmaprefault(void)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0 || (v->flags & MAP_SHARED) == 0)
+      continue;
+    for(uint64 a = v->start; a < v->end; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0 && vmfault(p->pagetable, a, PTE_R) != 0)
+        return -1;
+  }
+  return 0;
+}
+
+// Return p's demand-paged region containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Map the whole 2MB-aligned heap region around va with a
+// zeroed superpage, if all of it is heap and none of it has
+// been touched yet. Returns 0 on success, -1 if the region
+// should be mapped page by page instead.
+static int
+heapsuper(struct proc *p, uint64 va)
+{
+  uint64 a = SUPERPGROUNDDOWN(va);
   pte_t *pte;
-  
+  char *mem;
+
+  if(a < p->heapbase || a + SUPERPGSIZE > p->sz)
+    return -1;
+  pte = &p->pagetable[PX(2, a)];
+  if(*pte & PTE_V){
+    pte = &((pagetable_t)PTE2PA(*pte))[PX(1, a)];
+    if(*pte & PTE_V)
+      return -1;
+  }
+  if((mem = kalloc_pages(SUPERORDER)) == 0)
+    return -1;
+  memset(mem, 0, SUPERPGSIZE);
+  if(mapsuper(p->pagetable, a, SUPERPGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+    kfree_pages(mem, SUPERORDER);
+    return -1;
+  }
+  return 0;
+}
+
+// Allocate a page for user memory, zeroed if zero is set.
+// If memory has run out, first free text cache pages that
+// no process is using, then swap out user pages.
+static char*
+uvmkalloc(int zero)
+{
+  char *mem;
+
+  for(;;){
+    if((mem = zero ? kalloc_zeroed() : kalloc()) != 0)
+      return mem;
+    if(textreclaim() == 0 && swapout() == 0)
+      return 0;
+  }
+}
+
+// Read the page in the swap slot that *pte refers to back in,
+// and map it again.
+static int
+swapin(pte_t *pte)
+{
+  int slot = PTE2SLOT(*pte);
+  char *mem;
+
+  if((mem = uvmkalloc(0)) == 0)
+    return -1;
+  if(swapread(slot, mem) != 0){
+    kfree(mem);
+    return -1;
+  }
+  *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_V;
+  swapput(slot);
+  return 0;
+}
+
+// Advance the swap clock hand through p's memory from *va up
+// to p->sz, for swapout(). Clears PTE_A on pages used since
+// the hand last came by, and returns the PTE of the first
+// page that hasn't been, with *va set to its address. Only
+// private 4KB pages that no other page table maps, and that
+// a system call hasn't prefaulted, can be swapped; superpages
+// stay put. Each page examined uses up one of *budget.
+// Returns 0 at p->sz or when the budget runs out.
+// Caller must hold p->lock.
+pte_t*
+uvmclock(struct proc *p, uint64 *va, int *budget)
+{
+  struct vma *v;
+  pte_t *pte;
+  uint64 a;
+
+  for(a = PGROUNDDOWN(*va); a < p->sz && *budget > 0; a += PGSIZE){
+    (*budget)--;
+    if(superpte(p->pagetable, a) != 0 || (pte = walk(p->pagetable, a, 0)) == 0){
+      a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE - PGSIZE;
+      continue;
+    }
+    if((*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if(krefcnt((void*)PTE2PA(*pte)) != 1)
+      continue;
+    if((v = findvma(p, a)) != 0 && (v->flags & MAP_SHARED))
+      continue;
+    if(a >= p->pinstart && a < p->pinend)
+      continue;
+    *va = a;
+    return pte;
+  }
+  *va = a;
+  return 0;
+}
+
+// Read the page at va of region v in from its file and map it,
+// for an access of the given kind. Read-only pages come from
+// the shared text cache. Data past the end of the file reads
+// as zeroes.
+static int
+vmaload(pagetable_t pagetable, struct vma *v, uint64 va, int access)
+{
+  uint64 off = va - v->start;
+  uint n = 0;
+  int perm = v->perm;
+  char *mem;
+
+  if(off < v->filesz){
+    // see uvmprefault().
+    if(intr_get() == 0)
+      return -1;
+    n = v->filesz - off < PGSIZE ? v->filesz - off : PGSIZE;
+  }
+
+  if((v->perm & PTE_W) == 0){
+    if((mem = textpage(v->ip, v->off + off, n)) == 0)
+      return -1;
+  } else {
+    if((mem = uvmkalloc(1)) == 0)
+      return -1;
+    if(n > 0){
+      ilock(v->ip);
+      if(readi(v->ip, 0, (uint64)mem, v->off + off, n) < 0){
+        iunlock(v->ip);
+        kfree(mem);
+        return -1;
+      }
+      iunlock(v->ip);
+    }
+    // a MAP_SHARED page is mapped writable (and marked
+    // dirty, to be written back) only once it is written.
+    if(v->flags & MAP_SHARED)
+      perm = access == PTE_W ? perm | PTE_D : perm & ~PTE_W;
+  }
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, perm | PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Try to resolve a user page fault at virtual address va
+// in pagetable. access is PTE_R, PTE_W or PTE_X, for a
+// load, store or instruction fetch.
+// Reads in pages of the program that exec() hasn't loaded
+// yet, maps a zeroed page (or 2MB superpage) for heap memory
+// that sbrk() handed out but that hasn't been touched, maps
+// zeroed pages as the user stack grows down, and gives the
+// process its own copy of a copy-on-write page.
+// Returns 0 if the access can now be retried, -1 if
+// va isn't accessible (or memory ran out).
+int
+vmfault(pagetable_t pagetable, uint64 va, int access)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if(va >= USERTOP)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = superpte(pagetable, va)) != 0){
+    if((*pte & PTE_U) == 0)
+      return -1;
+    if(*pte & access)
+      return 0;  // spurious; see below.
+    if(access != PTE_W || (*pte & PTE_COW) == 0)
+      return -1;
+    // a write to a copy-on-write superpage: walk() splits
+    // it, then copy just the 4KB page written.
+  }
   pte = walk(pagetable, va, 0);
-  if(pte == 0)
-    panic("uvmclear");
-  *pte &= ~PTE_U;
+  if(pte && (*pte & PTE_SWAP))
+    return swapin(pte);
+  if(pte == 0 || (*pte & PTE_V) == 0){
+    if(p == 0 || pagetable != p->pagetable)
+      return -1;
+    if((v = findvma(p, va)) != 0){
+      if((v->perm & access) == 0)
+        return -1;
+      return vmaload(pagetable, v, va, access);
+    }
+    // heap, or stack growing down towards p->stackbase.
+    if(va < p->stackbase || va >= p->sz || access == PTE_X)
+      return -1;
+    if(heapsuper(p, va) == 0)
+      return 0;
+    if((mem = uvmkalloc(1)) == 0)
+      return -1;
+    if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) != 0){
+      kfree(mem);
+      return -1;
+    }
+    return 0;
+  }
+  if((*pte & PTE_U) == 0)
+    return -1;
+
+  if(access == PTE_W && (*pte & PTE_COW)){
+    pa = PTE2PA(*pte);
+    if(krefcnt((void*)pa) == 1){
+      // nobody else maps it any more; take it over.
+      *pte = (*pte & ~PTE_COW) | PTE_W;
+    } else {
+      // hold on to pa in case uvmkalloc() swaps out the
+      // other processes' copies of it.
+      kaddref((void*)pa);
+      if((mem = uvmkalloc(0)) == 0){
+        kfree((void*)pa);
+        return -1;
+      }
+      memmove(mem, (char*)pa, PGSIZE);
+      *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+      kfree((void*)pa);
+      kfree((void*)pa);
+    }
+    uvmflush(pagetable, va, 1);
+    return 0;
+  }
+
+  if(access == PTE_W && (*pte & PTE_W) == 0 && p && pagetable == p->pagetable &&
+     (v = findvma(p, va)) != 0 && (v->flags & MAP_SHARED) && (v->perm & PTE_W)){
+    // first write to a MAP_SHARED page.
+    *pte |= PTE_W | PTE_D;
+    uvmflush(pagetable, va, 1);
+    return 0;
+  }
+
+  // the hardware may fault on a PTE that another fault on
+  // this page just made valid, without an sfence.vma in
+  // between; the access only needs a retry.
+  if(*pte & access)
+    return 0;
+
+  return -1;
+}
+
+// Make sure the current process's file-backed and swapped-out
+// pages in [va, va+n) are resident, before a system call
+// copies to or from them while holding locks. A fault then
+// can't sleep for the disk while holding a spinlock, so
+// vmaload() and swapread() fail instead of reading them in.
+// The system call may sleep before it copies, so uvmclock()
+// leaves the pages alone until it returns (see syscall()).
+void
+uvmprefault(uint64 va, uint64 n)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint64 a, last;
+
+  if(va + n < va)
+    return;
+  p->pinstart = PGROUNDDOWN(va);
+  p->pinend = va + n;
+  for(a = PGROUNDDOWN(va); a < va + n && a < p->sz; a += PGSIZE){
+    if(superpte(p->pagetable, a) != 0)
+      continue;
+    if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_SWAP))
+      swapin(pte);
+  }
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0 || va >= v->end || va + n <= v->start)
+      continue;
+    a = PGROUNDDOWN(va > v->start ? va : v->start);
+    last = va + n < v->end ? va + n : v->end;
+    for(; a < last; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0)
+        vmfault(p->pagetable, a, PTE_R);
+  }
+}
+
+// Write the dirty pages of MAP_SHARED region v in [a, b)
+// back to its file, through the log. Doesn't extend the file.
+static void
+writeback(pagetable_t pagetable, struct vma *v, uint64 a, uint64 b)
+{
+  // as in filewrite(), write a few blocks per transaction.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint64 va, pa;
+  uint off, n, n1;
+  pte_t *pte;
+
+  for(va = a; va < b; va += PGSIZE){
+    pte = walk(pagetable, va, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    off = v->off + (va - v->start);
+    for(n = 0; n < PGSIZE; n += n1){
+      n1 = PGSIZE - n < max ? PGSIZE - n : max;
+      begin_op();
+      ilock(v->ip);
+      if(off + n >= v->ip->size)
+        n1 = 0;
+      else if(off + n + n1 > v->ip->size)
+        n1 = v->ip->size - (off + n);
+      if(n1 > 0)
+        writei(v->ip, 0, pa + n, off + n, n1);
+      iunlock(v->ip);
+      end_op();
+      if(n1 == 0)
+        break;
+    }
+  }
+}
+
+// Remove the current process's mappings in [addr, addr+len),
+// for munmap(), exec() and exit(). Writes dirty MAP_SHARED
+// pages back to their files, and trims, splits or frees the
+// regions involved. addr must be page-aligned.
+// Returns 0 on success, -1 if splitting a region would need
+// more than NVMA regions.
+int
+vmaunmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *w;
+  uint64 a, b, end;
+  int nfree = 0, nsplit = 0;
+
+  if(addr % PGSIZE != 0)
+    return -1;
+  end = addr + PGROUNDUP(len);
+  if(end < addr || end > MAXVA)
+    end = MAXVA;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0)
+      nfree++;
+    else if(addr > v->start && end < v->end)
+      nsplit++;
+  }
+  if(nsplit > nfree)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->ip == 0 || end <= v->start || addr >= v->end)
+      continue;
+    a = addr > v->start ? addr : v->start;
+    b = end < v->end ? end : v->end;
+    if(v->flags & MAP_SHARED)
+      writeback(p->pagetable, v, a, b);
+    uvmunmap(p->pagetable, a, (b - a) / PGSIZE, 1);
+
+    if(a > v->start && b < v->end){
+      // punch a hole: the part above it becomes a new region.
+      for(w = p->vma; w->ip; w++)
+        ;
+      *w = *v;
+      w->start = b;
+      w->off += b - v->start;
+      w->filesz = w->filesz > b - v->start ? w->filesz - (b - v->start) : 0;
+      idup(w->ip);
+    }
+    if(a > v->start){
+      v->end = a;
+      if(v->filesz > a - v->start)
+        v->filesz = a - v->start;
+    } else if(b < v->end){
+      v->off += b - v->start;
+      v->filesz = v->filesz > b - v->start ? v->filesz - (b - v->start) : 0;
+      v->start = b;
+    } else {
+      begin_op();
+      iput(v->ip);
+      end_op();
+      v->ip = 0;
+    }
+  }
+  return 0;
+}
+
+// Choose where to put an mmap() region of len bytes (a
+// multiple of PGSIZE): at addr if that's free, otherwise in
+// the highest free space below MMAPTOP, above the heap.
+// Returns 0 if there's no room.
+uint64
+vmaplace(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 lo = PGROUNDUP(p->sz);
+  int moved;
+
+  if(addr % PGSIZE == 0 && addr >= lo && addr + len >= addr &&
+     addr + len <= MMAPTOP && vmaoverlap(p, addr, addr + len) == 0)
+    return addr;
+
+  if(len > MMAPTOP - lo)
+    return 0;
+  addr = MMAPTOP - len;
+  do {
+    moved = 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++){
+      if(v->ip && addr < v->end && addr + len > v->start){
+        if(v->start < lo + len)
+          return 0;
+        addr = v->start - len;
+        moved = 1;
+      }
+    }
+  } while(moved);
+  return addr;
+}
+
+// Does any of p's regions overlap [start, end)?
+int
+vmaoverlap(struct proc *p, uint64 start, uint64 end)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->ip && start < v->end && end > v->start)
+      return 1;
+  return 0;
+}
+
+// Copy a table of NVMA regions for fork().
+void
+vmadup(struct vma *dst, struct vma *src)
+{
+  for(int i = 0; i < NVMA; i++){
+    dst[i] = src[i];
+    if(src[i].ip)
+      idup(src[i].ip);
+  }
+}
+
+// Give up a table of NVMA regions' file references.
+// Must be called inside a transaction, since it calls iput().
+void
+vmarelease(struct vma *vma)
+{
+  for(int i = 0; i < NVMA; i++){
+    if(vma[i].ip)
+      iput(vma[i].ip);
+    vma[i].ip = 0;
+  }
+}
+
+// Look up user virtual address va for a kernel access on the
+// process's behalf, fixing up the page with vmfault() the way
+// a user access would. Returns the physical address of the
+// page, or 0 if va can't be accessed that way.
+static uint64
+uvmpage(pagetable_t pagetable, uint64 va, int write)
+{
+  pte_t *pte;
+  uint64 pa;
+
+  pte = lookup(pagetable, va, &pa);
+  if(pte == 0 || (*pte & PTE_U) == 0 || (write && (*pte & PTE_W) == 0)){
+    if(vmfault(pagetable, va, write ? PTE_W : PTE_R) != 0)
+      return 0;
+    if(lookup(pagetable, va, &pa) == 0)
+      return 0;
+  }
+  return pa;
+}
+
+// Can the current process's user memory in [va, va+len) be
+// reached directly, through its kernel page table?
+static int
+uaccessok(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+
+  return p != 0 && pagetable == p->pagetable &&
+    va < USERTOP && len <= USERTOP - va;
 }
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// The current process's memory is copied to directly; another page
+// table's (exec() building a new one) through its physical pages.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
-  pte_t *pte;
+
+  if(uaccessok(pagetable, dstva, len))
+    return copyuser((void*)dstva, src, len);
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    if(va0 >= MAXVA)
-      return -1;
-    pte = walk(pagetable, va0, 0);
-    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 ||
-       (*pte & PTE_W) == 0)
+    if((pa0 = uvmpage(pagetable, va0, 1)) == 0)
       return -1;
-    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -390,10 +1424,12 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(uaccessok(pagetable, srcva, len))
+    return copyuser(dst, (void*)srcva, len);
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = uvmpage(pagetable, va0, 0)) == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
@@ -417,10 +1453,15 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   uint64 n, va0, pa0;
   int got_null = 0;
 
+  if(uaccessok(pagetable, srcva, 1)){
+    if(max > USERTOP - srcva)
+      max = USERTOP - srcva;
+    return copyuserstr(dst, (char*)srcva, max);
+  }
+
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = uvmpage(pagetable, va0, 0)) == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
@@ -0,0 +1,97 @@
+// Context-switch benchmark.
+//
+// Two processes bounce a byte back and forth over a pair of
+// pipes, so each round trip switches from one to the other
+// and back. Between switches, each process reads one byte
+// from each of a number of pages of its memory, which costs
+// more if the switch threw away the TLB entries for them.
+// Run with 1 CPU (make CPUS=1 qemu) to see the switches
+// rather than the pipe wakeups across CPUs.
+//
+// usage: ctxbench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define MAXPAGES 64
+
+// one byte read from each of npages pages of mem.
+int
+touch(char *mem, int npages)
+{
+  int sum = 0;
+
+  for(int i = 0; i < npages; i++)
+    sum += mem[i * PGSIZE];
+  return sum;
+}
+
+// rounds round trips between two processes, each touching
+// npages pages per round. returns the ticks taken.
+int
+pingpong(int rounds, int npages)
+{
+  int p2c[2], c2p[2], t0, pid;
+  char *mem, b = 0;
+
+  if(pipe(p2c) < 0 || pipe(c2p) < 0){
+    fprintf(2, "ctxbench: pipe failed\n");
+    exit(1);
+  }
+  if((mem = sbrk(MAXPAGES * PGSIZE)) == (char*)-1){
+    fprintf(2, "ctxbench: sbrk failed\n");
+    exit(1);
+  }
+  memset(mem, 1, MAXPAGES * PGSIZE);
+
+  t0 = uptime();
+  if((pid = fork()) < 0){
+    fprintf(2, "ctxbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // write to the pages, so the child has its own copies.
+    memset(mem, 2, MAXPAGES * PGSIZE);
+    close(p2c[1]);
+    close(c2p[0]);
+    while(read(p2c[0], &b, 1) == 1){
+      b += touch(mem, npages);
+      write(c2p[1], &b, 1);
+    }
+    exit(0);
+  }
+  close(p2c[0]);
+  close(c2p[1]);
+  for(int i = 0; i < rounds; i++){
+    b += touch(mem, npages);
+    if(write(p2c[1], &b, 1) != 1 || read(c2p[0], &b, 1) != 1){
+      fprintf(2, "ctxbench: pipe failed\n");
+      exit(1);
+    }
+  }
+  close(p2c[1]);
+  close(c2p[0]);
+  wait(0);
+  sbrk(-MAXPAGES * PGSIZE);
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int npages[] = { 0, 8, MAXPAGES };
+  int rounds = 10000;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    fprintf(2, "usage: ctxbench [rounds]\n");
+    exit(1);
+  }
+
+  for(int i = 0; i < sizeof(npages)/sizeof(npages[0]); i++)
+    printf("ctxbench: %d round trips touching %d pages: %d ticks\n",
+           rounds, npages[i], pingpong(rounds, npages[i]));
+  exit(0);
+}
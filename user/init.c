@@ -22,6 +22,7 @@ main(void)
   }
   dup(0);  // stdout
   dup(0);  // stderr
+  mknod("meminfo", MEMINFO, 0);  // fails if it's already there
 
   for(;;){
     printf("init: starting sh\n");
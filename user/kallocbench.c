@@ -0,0 +1,82 @@
+// Page allocator contention benchmark.
+//
+// Runs nchild processes at once, each repeatedly growing and
+// shrinking its heap with sbrk(), so that every hart hammers
+// kalloc() and kfree(). Run it under different CPUS= settings
+// (e.g. make CPUS=1 qemu ... make CPUS=8 qemu) and compare the
+// pages/tick figures to see how the allocator scales.
+//
+// usage: kallocbench [nchild [rounds]]
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NPAGES 64    // pages per sbrk() in each round
+
+void
+churn(int rounds)
+{
+  for(int i = 0; i < rounds; i++){
+    char *a = sbrk(NPAGES * PGSIZE);
+    if(a == (char*)-1){
+      printf("kallocbench: sbrk failed\n");
+      exit(1);
+    }
+    // touch each page so the allocation can't be skipped.
+    for(int j = 0; j < NPAGES; j++)
+      a[j * PGSIZE] = j;
+    if(sbrk(-NPAGES * PGSIZE) == (char*)-1){
+      printf("kallocbench: sbrk shrink failed\n");
+      exit(1);
+    }
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nchild = 4, rounds = 200;
+  int t0, t1, i, xstatus, failed = 0;
+
+  if(argc > 1)
+    nchild = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(nchild < 1 || rounds < 1){
+    fprintf(2, "usage: kallocbench [nchild [rounds]]\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(i = 0; i < nchild; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "kallocbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      churn(rounds);
+  }
+  for(i = 0; i < nchild; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      failed = 1;
+  }
+  t1 = uptime();
+
+  if(failed){
+    printf("kallocbench: FAILED\n");
+    exit(1);
+  }
+
+  int pages = nchild * rounds * NPAGES;
+  int ticks = t1 - t0;
+  printf("kallocbench: %d children, %d pages allocated+freed in %d ticks",
+         nchild, pages, ticks);
+  if(ticks > 0)
+    printf(" (%d pages/tick)", pages / ticks);
+  printf("\n");
+  exit(0);
+}
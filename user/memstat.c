@@ -0,0 +1,51 @@
+// Print the kernel's memory report from /meminfo: free pages,
+// page-table pages, slab caches, swap, and each process's
+// resident pages. With an interval, print it again every
+// that many ticks.
+//
+// usage: memstat [interval]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+char buf[512];
+
+void
+memstat(void)
+{
+  int fd, n;
+
+  if((fd = open("/meminfo", O_RDONLY)) < 0){
+    fprintf(2, "memstat: cannot open /meminfo\n");
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+  if(n < 0){
+    fprintf(2, "memstat: read error\n");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval = 0;
+
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  if(argc > 2 || interval < 0){
+    fprintf(2, "usage: memstat [interval]\n");
+    exit(1);
+  }
+
+  memstat();
+  while(interval > 0){
+    sleep(interval);
+    printf("\n");
+    memstat();
+  }
+  exit(0);
+}
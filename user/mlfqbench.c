@@ -0,0 +1,71 @@
+// Scheduler latency benchmark.
+//
+// A number of batch processes spin on the CPU, while an
+// interactive one repeatedly sleeps for a tick and sees how
+// late it wakes up. With round-robin scheduling, a wakeup
+// waits behind every batch process; with the multi-level
+// feedback queues, the batch processes sink to a low priority
+// and the interactive one runs first. Run with 1 CPU
+// (make CPUS=1 qemu) to make the batch processes compete.
+//
+// usage: mlfqbench [nbatch]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define NWAKE 50
+
+// time NWAKE sleeps of a tick with nbatch processes spinning
+// at nice level nice, and print how late they woke.
+void
+run(int nbatch, int nice)
+{
+  int pids[NPROC], t0, late, total = 0, worst = 0;
+
+  for(int i = 0; i < nbatch; i++){
+    if((pids[i] = fork()) < 0){
+      fprintf(2, "mlfqbench: fork failed\n");
+      exit(1);
+    }
+    if(pids[i] == 0){
+      setnice(getpid(), nice);
+      for(volatile int n = 0; ; n++)
+        ;
+    }
+  }
+
+  for(int i = 0; i < NWAKE; i++){
+    t0 = uptime();
+    sleep(1);
+    late = uptime() - t0 - 1;
+    total += late;
+    if(late > worst)
+      worst = late;
+  }
+
+  for(int i = 0; i < nbatch; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+  printf("mlfqbench: %d batch processes at nice %d: %d wakeups %d ticks late "
+         "in all, %d at worst\n", nbatch, nice, NWAKE, total, worst);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nbatch = 8;
+
+  if(argc > 1)
+    nbatch = atoi(argv[1]);
+  if(nbatch < 0 || nbatch > NPROC - 8){
+    fprintf(2, "usage: mlfqbench [nbatch]\n");
+    exit(1);
+  }
+
+  run(0, 0);
+  run(nbatch, 0);
+  run(nbatch, NPRIO - 1);
+  exit(0);
+}
@@ -0,0 +1,145 @@
+// read()/write() throughput benchmark.
+//
+// Moves data through a pipe and a file in chunks of various
+// sizes, and opens a file by a long path name many times,
+// so that most of the time goes to copying between user
+// and kernel memory: copyin() and copyout() for the data,
+// copyinstr() for the path. Run it before and after a
+// change to those to compare the ticks.
+//
+// usage: rwbench [megabytes]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MB (1024*1024)
+#define FILESZ (16*1024)   // fits in the buffer cache
+
+char buf[8192];
+
+// write mb megabytes into a pipe n bytes at a time, while
+// a child reads them out n bytes at a time.
+int
+pipebench(int mb, int n)
+{
+  int fds[2], t0, pid;
+  long tot;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "rwbench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if((pid = fork()) < 0){
+    fprintf(2, "rwbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    while(read(fds[0], buf, n) > 0)
+      ;
+    exit(0);
+  }
+  close(fds[0]);
+  for(tot = 0; tot < (long)mb * MB; tot += n){
+    if(write(fds[1], buf, n) != n){
+      fprintf(2, "rwbench: pipe write failed\n");
+      exit(1);
+    }
+  }
+  close(fds[1]);
+  wait(0);
+  return uptime() - t0;
+}
+
+// read mb megabytes from a file n bytes at a time. The file
+// is small enough to stay in the buffer cache, and is read
+// over and over.
+int
+filebench(int mb, int n)
+{
+  int fd, t0;
+  long tot;
+
+  if((fd = open("rwbench.tmp", O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "rwbench: create failed\n");
+    exit(1);
+  }
+  for(int off = 0; off < FILESZ; off += sizeof(buf))
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "rwbench: file write failed\n");
+      exit(1);
+    }
+  close(fd);
+
+  t0 = uptime();
+  for(tot = 0; tot < (long)mb * MB; tot += FILESZ){
+    if((fd = open("rwbench.tmp", O_RDONLY)) < 0){
+      fprintf(2, "rwbench: open failed\n");
+      exit(1);
+    }
+    for(int off = 0; off < FILESZ; off += n)
+      if(read(fd, buf, n) != n){
+        fprintf(2, "rwbench: file read failed\n");
+        exit(1);
+      }
+    close(fd);
+  }
+  unlink("rwbench.tmp");
+  return uptime() - t0;
+}
+
+// open and close a file by a long path name.
+int
+pathbench(int count)
+{
+  char path[128];
+  int fd, t0, i;
+
+  // ././././.../rwbench.tmp
+  for(i = 0; i + 2 < sizeof(path) - 12; i += 2){
+    path[i] = '.';
+    path[i+1] = '/';
+  }
+  strcpy(path + i, "rwbench.tmp");
+  if((fd = open(path, O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "rwbench: create failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < count; i++){
+    if((fd = open(path, O_RDONLY)) < 0){
+      fprintf(2, "rwbench: open failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  unlink("rwbench.tmp");
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int sizes[] = { 64, 512, 4096 };
+  int mb = 4;
+
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(mb < 1){
+    fprintf(2, "usage: rwbench [megabytes]\n");
+    exit(1);
+  }
+
+  for(int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    printf("rwbench: pipe %d MB in %d-byte chunks: %d ticks\n",
+           mb, sizes[i], pipebench(mb, sizes[i]));
+  for(int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    printf("rwbench: file %d MB in %d-byte chunks: %d ticks\n",
+           mb, sizes[i], filebench(mb, sizes[i]));
+  printf("rwbench: 2000 opens of a long path: %d ticks\n", pathbench(2000));
+  exit(0);
+}
@@ -0,0 +1,93 @@
+// Scheduler benchmark.
+//
+// Two processes bounce a byte back and forth over a pair of
+// pipes, as in ctxbench, while a number of other processes
+// sit asleep. Picking the next process to run shouldn't cost
+// more with more processes in the table, or with a larger
+// NPROC. Run with 1 CPU (make CPUS=1 qemu) so that each round
+// trip is two trips through the scheduler.
+//
+// usage: schedbench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// rounds round trips between two processes, with nsleep
+// more processes asleep. returns the ticks taken.
+int
+pingpong(int rounds, int nsleep)
+{
+  int p2c[2], c2p[2], idle[2], t0, pid;
+  char b = 0;
+
+  if(pipe(p2c) < 0 || pipe(c2p) < 0 || pipe(idle) < 0){
+    fprintf(2, "schedbench: pipe failed\n");
+    exit(1);
+  }
+
+  // the sleepers wait to read from idle until it is closed.
+  for(int i = 0; i < nsleep; i++){
+    if((pid = fork()) < 0){
+      fprintf(2, "schedbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(idle[1]);
+      read(idle[0], &b, 1);
+      exit(0);
+    }
+  }
+  close(idle[0]);
+
+  if((pid = fork()) < 0){
+    fprintf(2, "schedbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(idle[1]);
+    close(p2c[1]);
+    close(c2p[0]);
+    while(read(p2c[0], &b, 1) == 1)
+      write(c2p[1], &b, 1);
+    exit(0);
+  }
+  close(p2c[0]);
+  close(c2p[1]);
+
+  t0 = uptime();
+  for(int i = 0; i < rounds; i++){
+    if(write(p2c[1], &b, 1) != 1 || read(c2p[0], &b, 1) != 1){
+      fprintf(2, "schedbench: pipe failed\n");
+      exit(1);
+    }
+  }
+  t0 = uptime() - t0;
+
+  close(p2c[1]);
+  close(c2p[0]);
+  close(idle[1]);
+  for(int i = 0; i < nsleep + 1; i++)
+    wait(0);
+  return t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  // leave room for the shell, init, and the two that switch.
+  int nsleep[] = { 0, (NPROC - 8) / 2, NPROC - 8 };
+  int rounds = 10000;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    fprintf(2, "usage: schedbench [rounds]\n");
+    exit(1);
+  }
+
+  for(int i = 0; i < sizeof(nsleep)/sizeof(nsleep[0]); i++)
+    printf("schedbench: %d round trips with %d processes asleep: %d ticks\n",
+           rounds, nsleep[i], pingpong(rounds, nsleep[i]));
+  exit(0);
+}
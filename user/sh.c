@@ -231,6 +231,8 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+int gettoken(char**, char*, char**, char**);
 void runcmd(struct cmd*) __attribute__((noreturn));
 
 // Execute cmd.  Never returns.
@@ -310,6 +312,94 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Can line s be run with spawn() straight from the shell,
+// rather than by a forked copy of it? Only if it is a
+// pipeline of commands with redirections: nothing like ( ),
+// ; or & that needs a shell of its own, and nothing that
+// parsecmd() would reject, since a syntax error exits.
+int
+spawnable(char *s)
+{
+  char *es = s + strlen(s);
+  int tok, argc = 0;
+
+  while((tok = gettoken(&s, es, 0, 0)) != 0){
+    switch(tok){
+    case 'a':
+      if(++argc >= MAXARGS)
+        return 0;
+      break;
+    case '|':
+      if(argc == 0)
+        return 0;
+      argc = 0;
+      break;
+    case '<':
+    case '>':
+    case '+':
+      if(gettoken(&s, es, 0, 0) != 'a')
+        return 0;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return argc > 0;
+}
+
+// Start cmd, which spawnable() has vetted, using spawn().
+// fd[0..2] are the shell's descriptors to give the command
+// as its 0, 1 and 2. Returns the number of processes started.
+int
+spawncmd(struct cmd *cmd, int *fd)
+{
+  int p[2], f, n, nfd[3];
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  default:
+    panic("spawncmd");
+
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(spawn(ecmd->argv[0], ecmd->argv, fd, 3) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if((f = open(rcmd->file, rcmd->mode)) < 0){
+      fprintf(2, "open %s failed\n", rcmd->file);
+      return 0;
+    }
+    memmove(nfd, fd, sizeof(nfd));
+    nfd[rcmd->fd] = f;
+    n = spawncmd(rcmd->cmd, nfd);
+    close(f);
+    return n;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(pipe(p) < 0){
+      fprintf(2, "pipe failed\n");
+      return 0;
+    }
+    memmove(nfd, fd, sizeof(nfd));
+    nfd[1] = p[1];
+    n = spawncmd(pcmd->left, nfd);
+    memmove(nfd, fd, sizeof(nfd));
+    nfd[0] = p[0];
+    n += spawncmd(pcmd->right, nfd);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -327,7 +417,9 @@ main(void)
 {
   ttyraw(1); // enable raw mode for this process
   static char buf[100];
-  int fd;
+  int fd, n;
+  struct cmd *cmd;
+  int stdfd[3] = { 0, 1, 2 };
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -346,6 +438,14 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
+    if(spawnable(buf)){
+      // no need to fork a copy of the shell just to exec.
+      cmd = parsecmd(buf);
+      for(n = spawncmd(cmd, stdfd); n > 0; n--)
+        wait(0);
+      freecmd(cmd);
+      continue;
+    }
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -438,6 +538,44 @@ backcmd(struct cmd *subcmd)
   cmd->cmd = subcmd;
   return (struct cmd*)cmd;
 }
+
+// Free a command tree built by the constructors above.
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
 //PAGEBREAK!
 // Parsing
 
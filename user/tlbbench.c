@@ -0,0 +1,98 @@
+// TLB reach benchmark.
+//
+// Sweeps over a large heap region reading one byte per 4KB
+// page, so nearly every access needs a different TLB entry.
+// The sweep runs twice: over a region sbrk()ed all at once
+// on a 2MB boundary, which the kernel maps with 2MB
+// superpages, and over a region grown a page at a time,
+// which it has to map with 4KB pages. Compare the ticks.
+//
+// usage: tlbbench [megabytes [passes]]
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define MB (1024*1024)
+
+// sbrk() a whole region at once, starting on a 2MB boundary.
+char*
+bigregion(int sz)
+{
+  uint64 top = (uint64)sbrk(0);
+  char *a;
+
+  if(top % SUPERPGSIZE)
+    sbrk(SUPERPGSIZE - top % SUPERPGSIZE);
+  if((a = sbrk(sz)) == (char*)-1){
+    fprintf(2, "tlbbench: sbrk failed\n");
+    exit(1);
+  }
+  return a;
+}
+
+// grow a region one page at a time, touching each page as
+// it's added, so no 2MB of it is ever untouched heap.
+char*
+smallregion(int sz)
+{
+  char *a = sbrk(0), *p;
+
+  for(int i = 0; i < sz; i += PGSIZE){
+    if((p = sbrk(PGSIZE)) == (char*)-1){
+      fprintf(2, "tlbbench: sbrk failed\n");
+      exit(1);
+    }
+    *p = 1;
+  }
+  return a;
+}
+
+int
+sweep(char *a, int sz, int passes)
+{
+  volatile char *v = a;
+  int sum = 0, t0;
+
+  // fault everything in before starting the clock.
+  for(int i = 0; i < sz; i += PGSIZE)
+    v[i] = 1;
+
+  t0 = uptime();
+  for(int p = 0; p < passes; p++)
+    for(int i = 0; i < sz; i += PGSIZE)
+      sum += v[i];
+  if(sum != passes * (sz / PGSIZE))
+    printf("tlbbench: bad sum\n");
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb = 32, passes = 200;
+  int sz, t2m, t4k;
+  char *a;
+
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  if(argc > 2)
+    passes = atoi(argv[2]);
+  if(mb < 2 || passes < 1){
+    fprintf(2, "usage: tlbbench [megabytes [passes]]\n");
+    exit(1);
+  }
+  sz = mb * MB;
+
+  a = bigregion(sz);
+  t2m = sweep(a, sz, passes);
+  sbrk(-(sbrk(0) - a));
+
+  a = smallregion(sz);
+  t4k = sweep(a, sz, passes);
+  sbrk(-(sbrk(0) - a));
+
+  printf("tlbbench: %d MB x %d passes: %d ticks with 2MB pages, %d ticks with 4KB pages\n",
+         mb, passes, t2m, t4k);
+  exit(0);
+}
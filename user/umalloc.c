@@ -2,9 +2,15 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/fcntl.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
+//
+// Freeing a large block gives the whole pages inside the
+// free block it ends up in back to the kernel with madvise(),
+// so that a process's memory shrinks again after a peak.
 
 typedef long Align;
 
@@ -21,12 +27,17 @@ typedef union header Header;
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+// free() of a block at least this big (in Headers) releases
+// memory.
+#define RELEASEMIN (16*PGSIZE / sizeof(Header))
+
+// Put block bp on the free list, merging it with its
+// neighbours. Returns the free block that now holds it.
+static Header*
+insert(Header *bp)
 {
-  Header *bp, *p;
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -41,6 +52,31 @@ free(void *ap)
   } else
     p->s.ptr = bp;
   freep = p;
+  return p->s.ptr == bp ? bp : p;
+}
+
+// Give the whole pages inside free block h back to the
+// kernel. They read as zeroes if the block is used again.
+static void
+release(Header *h)
+{
+  uint64 a = PGROUNDUP((uint64)(h + 1));
+  uint64 b = PGROUNDDOWN((uint64)(h + h->s.size));
+
+  if(a < b)
+    madvise((void*)a, b - a, MADV_DONTNEED);
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+
+  bp = (Header*)ap - 1;
+  if(bp->s.size >= RELEASEMIN)
+    release(insert(bp));
+  else
+    insert(bp);
 }
 
 static Header*
@@ -56,7 +92,7 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  insert(hp);  // it's untouched, so nothing to release.
   return freep;
 }
 
@@ -10,6 +10,7 @@ int read(int, void*, int);
 int close(int);
 int kill(int);
 int exec(const char*, char**);
+int spawn(const char*, char**, int*, int);
 int open(const char*, int);
 int mknod(const char*, short, short);
 int unlink(const char*);
@@ -18,14 +19,19 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
 int ttyraw(int on);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int madvise(void*, uint, int);
+int pgaccess(void*, int, void*);
+int setnice(int, int);
 
 
 // ulib.c
+int getpid(void);
+int uptime(void);
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
 int strcmp(const char*, const char*);
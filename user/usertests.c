@@ -733,6 +733,129 @@ exectest(char *s)
 
 }
 
+// copy file src to dst, for textinval.
+static void
+copyprog(char *s, char *src, char *dst)
+{
+  int in, out, n;
+
+  in = open(src, O_RDONLY);
+  out = open(dst, O_CREATE|O_WRONLY|O_TRUNC);
+  if(in < 0 || out < 0){
+    printf("%s: open %s or %s failed\n", s, src, dst);
+    exit(1);
+  }
+  while((n = read(in, buf, sizeof(buf))) > 0){
+    if(write(out, buf, n) != n){
+      printf("%s: write %s failed\n", s, dst);
+      exit(1);
+    }
+  }
+  close(in);
+  close(out);
+}
+
+// run argv with output to file out, and check that the
+// output starts with want, for textinval.
+static void
+runprog(char *s, char **argv, char *out, char *want)
+{
+  int fd, pid, xstatus;
+  char got[8];
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    if(open(out, O_CREATE|O_WRONLY|O_TRUNC) != 1){
+      printf("%s: open %s failed\n", s, out);
+      exit(1);
+    }
+    exec(argv[0], argv);
+    printf("%s: exec %s failed\n", s, argv[0]);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  fd = open(out, O_RDONLY);
+  memset(got, 0, sizeof(got));
+  if(fd < 0 || read(fd, got, strlen(want)) != strlen(want) ||
+     strcmp(got, want) != 0){
+    printf("%s: %s wrote the wrong output\n", s, argv[0]);
+    exit(1);
+  }
+  close(fd);
+}
+
+// read-only program pages are cached and shared between
+// execs of a binary. make sure rewriting the binary
+// throws the old pages away.
+void
+textinval(char *s)
+{
+  char *echoargv[] = { "textprog", "OK", 0 };
+  char *catargv[] = { "textprog", "textout1", 0 };
+
+  copyprog(s, "echo", "textprog");
+  runprog(s, echoargv, "textout1", "OK");
+  runprog(s, echoargv, "textout1", "OK");
+  copyprog(s, "cat", "textprog");
+  runprog(s, catargv, "textout2", "OK");
+  unlink("textprog");
+  unlink("textout1");
+  unlink("textout2");
+}
+
+// spawn() a program with its stdout remapped to a pipe,
+// its stdin closed, and nothing else open.
+void
+spawntest(char *s)
+{
+  int fds[2], fdmap[3], pid, xstatus, n, tot;
+  char *echoargv[] = { "echo", "spawn", "OK", 0 };
+  char *badargv[] = { "no-such-program", 0 };
+  char buf[32];
+
+  if(spawn("no-such-program", badargv, 0, 0) != -1){
+    printf("%s: spawn of missing program succeeded\n", s);
+    exit(1);
+  }
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fdmap[0] = -1;
+  fdmap[1] = fds[1];
+  fdmap[2] = 2;
+  if(spawn("echo", echoargv, fdmap, NOFILE+1) != -1){
+    printf("%s: spawn with too many fds succeeded\n", s);
+    exit(1);
+  }
+  pid = spawn("echo", echoargv, fdmap, 3);
+  if(pid < 0){
+    printf("%s: spawn failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  tot = 0;
+  while((n = read(fds[0], buf + tot, sizeof(buf) - 1 - tot)) > 0)
+    tot += n;
+  buf[tot] = 0;
+  close(fds[0]);
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  if(strcmp(buf, "spawn OK\n") != 0){
+    printf("%s: wrong output %s\n", s, buf);
+    exit(1);
+  }
+}
+
 // simple fork and pipe read/write
 
 void
@@ -1919,6 +2042,10 @@ dirfile(char *s)
   close(fd);
 }
 
+// the kernel's in-memory inode table used to have room
+// for this many; iref makes sure none are leaked.
+#define NINODE 50
+
 // test that iput() is called at the end of _namei().
 // also tests empty file names.
 void
@@ -2414,8 +2541,9 @@ stacktest(char *s)
   pid = fork();
   if(pid == 0) {
     char *sp = (char *) r_sp();
-    sp -= USERSTACK*PGSIZE;
-    // the *sp should cause a trap.
+    sp -= MAXSTACK*PGSIZE;
+    // the *sp should cause a trap: it's below the space
+    // the stack can grow into, in the guard page.
     printf("%s: stacktest: read below stack %d\n", s, *sp);
     exit(1);
   } else if(pid < 0){
@@ -2429,6 +2557,138 @@ stacktest(char *s)
     exit(xstatus);
 }
 
+// recurse n deep, with a large stack frame at each level.
+// returns 0 if each frame kept its contents.
+int
+stackgrow1(int n)
+{
+  volatile char buf[1000];
+
+  buf[0] = buf[sizeof(buf)-1] = n;
+  if(n > 0 && stackgrow1(n - 1) != 0)
+    return -1;
+  return buf[0] == (char)n && buf[sizeof(buf)-1] == (char)n ? 0 : -1;
+}
+
+// the user stack grows on demand past the USERSTACK pages
+// exec() sets up.
+void
+stackgrow(char *s)
+{
+  if(stackgrow1(MAXSTACK/2 * PGSIZE / 1024) != 0){
+    printf("%s: deep recursion lost stack contents\n", s);
+    exit(1);
+  }
+}
+
+// getpid() reads the USYSCALL page, which follows fork(),
+// and which user code can't write.
+void
+usyscalltest(char *s)
+{
+  int fds[2], pid, cpid, xstatus;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    cpid = getpid();
+    write(fds[1], &cpid, sizeof(cpid));
+    exit(0);
+  }
+  if(read(fds[0], &cpid, sizeof(cpid)) != sizeof(cpid) || cpid != pid){
+    printf("%s: child's getpid() %d, fork() said %d\n", s, cpid, pid);
+    exit(1);
+  }
+  wait(0);
+
+  pid = fork();
+  if(pid == 0){
+    *(volatile int *)USYSCALL = 0;
+    printf("%s: write to USYSCALL did not fail!\n", s);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: write to USYSCALL didn't kill the process\n", s);
+    exit(1);
+  }
+}
+
+// setnice() checks its arguments, returns the old level,
+// and fork() passes the level on.
+void
+setnicetest(char *s)
+{
+  int pid = getpid(), xstatus;
+
+  if(setnice(pid, -1) != -1 || setnice(pid, NPRIO) != -1 || setnice(-1, 0) != -1){
+    printf("%s: setnice() accepted bad arguments\n", s);
+    exit(1);
+  }
+  if(setnice(pid, NPRIO-1) != 0){
+    printf("%s: setnice() didn't return old level 0\n", s);
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(setnice(getpid(), 0));
+  wait(&xstatus);
+  if(xstatus != NPRIO-1){
+    printf("%s: child's nice level %d, not %d\n", s, xstatus, NPRIO-1);
+    exit(1);
+  }
+  if(setnice(getpid(), 0) != NPRIO-1){
+    printf("%s: setnice() didn't return old level %d\n", s, NPRIO-1);
+    exit(1);
+  }
+}
+
+// read /meminfo a few bytes at a time, and look for
+// this process in the report.
+void
+meminfotest(char *s)
+{
+  static char report[4096];
+  int fd, n, tot = 0;
+
+  if((fd = open("/meminfo", O_RDONLY)) < 0){
+    printf("%s: open /meminfo failed\n", s);
+    exit(1);
+  }
+  while((n = read(fd, report + tot, 7)) > 0){
+    tot += n;
+    if(tot + 7 >= sizeof(report)){
+      printf("%s: /meminfo doesn't end\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if(n < 0 || tot == 0){
+    printf("%s: read /meminfo failed\n", s);
+    exit(1);
+  }
+  report[tot] = 0;
+  if(strncmp(report, "free", 4) != 0){
+    printf("%s: /meminfo doesn't start with free pages\n", s);
+    exit(1);
+  }
+  for(n = 0; n < tot; n++)
+    if(strncmp(report + n, " usertests\n", 11) == 0)
+      return;
+  printf("%s: usertests isn't in /meminfo\n", s);
+  exit(1);
+}
+
 // check that writes to a few forbidden addresses
 // cause a fault, e.g. process's text and TRAMPOLINE.
 void
@@ -2571,6 +2831,382 @@ sbrk8000(char *s)
 
 
 
+// fork() shares memory copy-on-write, so a process using
+// more than half of physical memory can still fork, and
+// parent and child each see only their own writes.
+void
+cowfork(char *s)
+{
+  int sz = 80*1024*1024;
+  int xstatus;
+  char *a, *q;
+
+  a = sbrk(sz);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(q = a; q < a + sz; q += PGSIZE)
+    *(int*)q = 1;
+
+  for(int i = 0; i < 3; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(q = a; q < a + sz; q += PGSIZE)
+        if(*(int*)q != 1)
+          exit(1);
+      for(q = a; q < a + 16*PGSIZE; q += PGSIZE)
+        *(int*)q = 2 + i;
+      for(q = a; q < a + 16*PGSIZE; q += PGSIZE)
+        if(*(int*)q != 2 + i)
+          exit(1);
+      exit(0);
+    }
+    for(q = a + sz - 16*PGSIZE; q < a + sz; q += PGSIZE)
+      *(int*)q = 1;
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child saw wrong data\n", s);
+      exit(1);
+    }
+    for(q = a; q < a + 16*PGSIZE; q += PGSIZE){
+      if(*(int*)q != 1){
+        printf("%s: parent saw child's write\n", s);
+        exit(1);
+      }
+    }
+  }
+  sbrk(-sz);
+}
+
+// sbrk() should hand out memory without allocating it, and
+// system calls should work on heap pages that haven't been
+// touched yet.
+void
+lazysbrk(char *s)
+{
+  uint64 sz = 128*1024*1024;
+  int fd, fds[2];
+  char *a;
+
+  a = sbrk(sz);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk of 128MB failed\n", s);
+    exit(1);
+  }
+  a[sz/2] = 1;
+  a[sz-1] = 2;
+  if(a[0] != 0 || a[sz/2] != 1 || a[sz-1] != 2){
+    printf("%s: wrong contents\n", s);
+    exit(1);
+  }
+
+  // copyin() from untouched pages.
+  fd = open("lazysbrk", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if(write(fd, a + 3*PGSIZE, 2*PGSIZE) != 2*PGSIZE){
+    printf("%s: write from untouched heap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("lazysbrk");
+
+  // copyout() to an untouched page.
+  if(pipe(fds) != 0 || write(fds[1], "x", 1) != 1){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], a + sz - 3*PGSIZE, 1) != 1 || a[sz - 3*PGSIZE] != 'x'){
+    printf("%s: read into untouched heap failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  sbrk(-sz);
+}
+
+// large aligned heap regions get 2MB superpages. check that
+// fork, copy-on-write and shrinking the heap into the middle
+// of one still behave.
+void
+superpg(char *s)
+{
+  uint64 top = (uint64)sbrk(0);
+  int sz = 2*SUPERPGSIZE, xstatus;
+  char *a;
+
+  if(top % SUPERPGSIZE)
+    sbrk(SUPERPGSIZE - top % SUPERPGSIZE);
+  a = sbrk(sz);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < sz; i += PGSIZE)
+    a[i] = i / PGSIZE;
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < sz; i += PGSIZE)
+      a[i] = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  // shrink into the middle of the second superpage.
+  sbrk(-(SUPERPGSIZE/2));
+  for(int i = 0; i < sz - SUPERPGSIZE/2; i += PGSIZE){
+    if(a[i] != (char)(i / PGSIZE)){
+      printf("%s: wrong data at %p\n", s, a + i);
+      exit(1);
+    }
+  }
+  sbrk(SUPERPGSIZE/2);
+  if(a[sz - PGSIZE] != 0){
+    printf("%s: heap not zeroed after regrowing\n", s);
+    exit(1);
+  }
+}
+
+// madvise(MADV_DONTNEED) frees heap pages, which read as
+// zero afterwards, and leaves the pages around them alone.
+void
+madvisetest(char *s)
+{
+  enum { N = 64 };
+  char *a = sbrk(0), *b;
+  int i;
+
+  a += PGSIZE - (uint64)a % PGSIZE;
+  if(sbrk(a - sbrk(0) + N*PGSIZE) == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    a[i*PGSIZE] = 1;
+  if(madvise(a + PGSIZE, (N-2)*PGSIZE, MADV_DONTNEED) != 0){
+    printf("%s: madvise failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(a[i*PGSIZE] != (i == 0 || i == N-1)){
+      printf("%s: page %d has %d after madvise\n", s, i, a[i*PGSIZE]);
+      exit(1);
+    }
+  }
+
+  // not page-aligned, past the heap, bad advice.
+  if(madvise(a + 1, PGSIZE, MADV_DONTNEED) == 0 ||
+     madvise(a, 2*N*PGSIZE, MADV_DONTNEED) == 0 ||
+     madvise(a, PGSIZE, 0) == 0){
+    printf("%s: bad madvise succeeded\n", s);
+    exit(1);
+  }
+
+  // free() of a big block gives back its pages; the memory
+  // must still work when malloc() hands it out again.
+  for(i = 0; i < 4; i++){
+    if((b = malloc(32*PGSIZE)) == 0){
+      printf("%s: malloc failed\n", s);
+      exit(1);
+    }
+    memset(b, i, 32*PGSIZE);
+    if(b[31*PGSIZE] != i){
+      printf("%s: malloc()ed memory lost a write\n", s);
+      exit(1);
+    }
+    free(b);
+  }
+}
+
+// pgaccess() reports the pages used since it was last asked.
+void
+pgaccesstest(char *s)
+{
+  enum { N = 32 };
+  char *a;
+  uint mask;
+
+  a = sbrk(N*PGSIZE);
+  if(a == (char*)-1){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++)
+    a[i*PGSIZE] = 1;
+  if(pgaccess(a, N, &mask) != 0){
+    printf("%s: pgaccess failed\n", s);
+    exit(1);
+  }
+  a[1*PGSIZE] += 1;
+  a[2*PGSIZE] += 1;
+  a[30*PGSIZE] += 1;
+  if(pgaccess(a, N, &mask) != 0){
+    printf("%s: pgaccess failed\n", s);
+    exit(1);
+  }
+  if(mask != ((1 << 1) | (1 << 2) | (1 << 30))){
+    printf("%s: pgaccess mask %x\n", s, mask);
+    exit(1);
+  }
+  if(pgaccess(a, N, &mask) != 0 || mask != 0){
+    printf("%s: pgaccess didn't clear the accessed bits\n", s);
+    exit(1);
+  }
+}
+
+// mmap() a file MAP_PRIVATE and MAP_SHARED. check that the
+// mappings see the file, that private writes stay private,
+// that shared writes reach the file and a forked child's
+// shared writes reach the parent, and that munmap() can
+// punch a hole in a mapping.
+void
+mmaptest(char *s)
+{
+  int n = 2*PGSIZE + PGSIZE/2;
+  int fd, pid, xstatus;
+  char *a;
+
+  for(int i = 0; i < n; i++)
+    buf[i] = 'a' + i % 23;
+  fd = open("mmapfile", O_CREATE|O_RDWR|O_TRUNC);
+  if(fd < 0 || write(fd, buf, n) != n){
+    printf("%s: create mmapfile failed\n", s);
+    exit(1);
+  }
+
+  a = mmap(0, n, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == (char*)-1){
+    printf("%s: mmap MAP_PRIVATE failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 3*PGSIZE; i++){
+    if(a[i] != (i < n ? buf[i] : 0)){
+      printf("%s: wrong data at offset %d\n", s, i);
+      exit(1);
+    }
+  }
+  a[0] = 'X';
+  if(munmap(a, n) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  a = mmap(0, n, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(a == (char*)-1){
+    printf("%s: mmap MAP_SHARED failed\n", s);
+    exit(1);
+  }
+  if(a[0] != buf[0]){
+    printf("%s: MAP_PRIVATE write reached the file\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[1] = 'Y';
+    a[PGSIZE] = 'Z';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(a[1] != 'Y' || a[PGSIZE] != 'Z'){
+    printf("%s: parent didn't see child's MAP_SHARED writes\n", s);
+    exit(1);
+  }
+  a[2*PGSIZE] = 'W';
+  if(munmap(a, n) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != n){
+    printf("%s: mmapfile has the wrong size\n", s);
+    exit(1);
+  }
+  if(buf[0] != 'a' || buf[1] != 'Y' || buf[PGSIZE] != 'Z' || buf[2*PGSIZE] != 'W'){
+    printf("%s: MAP_SHARED writes didn't reach the file\n", s);
+    exit(1);
+  }
+
+  // unmap the middle page of three.
+  a = mmap(0, n, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(a == (char*)-1 || munmap(a + PGSIZE, PGSIZE) < 0){
+    printf("%s: mmap or munmap of middle page failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 'a' || a[2*PGSIZE] != 'W'){
+    printf("%s: wrong data around hole\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    printf("%s: read unmapped page %d\n", s, a[PGSIZE]);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child wasn't killed\n", s);
+    exit(1);
+  }
+  munmap(a, 3*PGSIZE);
+  close(fd);
+  unlink("mmapfile");
+}
+
+// exec() reads a program's pages in on first touch. check that
+// initialized data comes out right, and that read() can fill a
+// data page that isn't resident yet from the program's own file.
+char lazydata[3*PGSIZE] = "lazy";
+void
+lazyexec(char *s)
+{
+  int fd;
+
+  if(strcmp(lazydata, "lazy") != 0){
+    printf("%s: wrong initialized data\n", s);
+    exit(1);
+  }
+  fd = open("usertests", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open usertests failed\n", s);
+    exit(1);
+  }
+  if(read(fd, lazydata + PGSIZE, PGSIZE) != PGSIZE){
+    printf("%s: read into untouched data failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(memcmp(lazydata + PGSIZE, "\x7f" "ELF", 4) != 0){
+    printf("%s: read wrong data\n", s);
+    exit(1);
+  }
+}
+
 // regression test. test whether exec() leaks memory if one of the
 // arguments is invalid. the test passes if the kernel doesn't panic.
 void
@@ -2608,6 +3244,7 @@ struct test {
   {createtest, "createtest"},
   {dirtest, "dirtest"},
   {exectest, "exectest"},
+  {spawntest, "spawntest"},
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
@@ -2644,12 +3281,24 @@ struct test {
   {bigargtest, "bigargtest"},
   {argptest, "argptest"},
   {stacktest, "stacktest"},
+  {stackgrow, "stackgrow"},
+  {usyscalltest, "usyscalltest"},
+  {meminfotest, "meminfotest"},
+  {setnicetest, "setnicetest"},
   {nowrite, "nowrite"},
   {pgbug, "pgbug" },
   {sbrkbugs, "sbrkbugs" },
   {sbrklast, "sbrklast"},
   {sbrk8000, "sbrk8000"},
   {badarg, "badarg" },
+  {cowfork, "cowfork" },
+  {lazysbrk, "lazysbrk" },
+  {superpg, "superpg" },
+  {madvisetest, "madvisetest" },
+  {pgaccesstest, "pgaccesstest" },
+  {mmaptest, "mmaptest" },
+  {lazyexec, "lazyexec" },
+  {textinval, "textinval" },
 
   { 0, 0},
 };
@@ -2939,6 +3588,130 @@ outofinodes(char *s)
   }
 }
 
+// use more memory than the machine has, so that the kernel
+// must swap some of it out, and check that it all reads back,
+// in this process and in a child that shares the swapped
+// pages after fork().
+void
+swaptest(char *s)
+{
+  enum { N = (PHYSTOP - KERNBASE + 32*1024*1024) / PGSIZE };
+  char *a;
+  int i, fd, pid, xstatus;
+
+  // grow a page at a time, so that the heap isn't mapped
+  // with superpages, which stay in memory.
+  a = sbrk(0);
+  for(i = 0; i < N; i++){
+    if(sbrk(PGSIZE) == (char*)-1){
+      printf("%s: sbrk failed\n", s);
+      exit(1);
+    }
+    *(int*)(a + i*PGSIZE) = i;
+  }
+  for(i = 0; i < N; i++){
+    if(*(int*)(a + i*PGSIZE) != i){
+      printf("%s: page %d has %d\n", s, i, *(int*)(a + i*PGSIZE));
+      exit(1);
+    }
+  }
+
+  // a system call that copies out to a swapped-out page.
+  if((fd = open("README", O_RDONLY)) < 0 || read(fd, a, 16) != 16){
+    printf("%s: read into swapped-out page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  *(int*)a = 0;
+
+  // free half, so that the child has room to read its own
+  // copies of the pages it shares with the parent.
+  if(sbrk(-(N/2)*PGSIZE) == (char*)-1){
+    printf("%s: sbrk shrink failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N/2; i++){
+      if(*(int*)(a + i*PGSIZE) != i){
+        printf("%s: child: page %d has %d\n", s, i, *(int*)(a + i*PGSIZE));
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
+// a child blocks reading a pipe into a buffer, while its
+// parent uses so much memory that the kernel swaps; the
+// buffer must stay resident until the read copies into it,
+// and no bytes may go missing.
+void
+swappipe(char *s)
+{
+  enum { N = (PHYSTOP - KERNBASE + 32*1024*1024) / PGSIZE, SZ = 8*PGSIZE };
+  static char buf[SZ];
+  char *a, chunk[512];
+  int i, n, tot, fds[2], pid, xstatus;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    memset(buf, 1, SZ);
+    for(tot = 0; (n = read(fds[0], buf + tot, SZ - tot)) > 0; tot += n)
+      ;
+    if(n < 0 || tot != SZ){
+      printf("%s: child read %d bytes, not %d\n", s, tot, SZ);
+      exit(1);
+    }
+    for(i = 0; i < SZ; i++){
+      if(buf[i] != (char)(i % 251)){
+        printf("%s: byte %d is %d\n", s, i, buf[i]);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[0]);
+
+  // let the child block in read(), then make the kernel swap.
+  sleep(1);
+  a = sbrk(0);
+  for(i = 0; i < N; i++){
+    if(sbrk(PGSIZE) == (char*)-1){
+      printf("%s: sbrk failed\n", s);
+      exit(1);
+    }
+    *(int*)(a + i*PGSIZE) = i;
+  }
+
+  for(tot = 0; tot < SZ; tot += sizeof(chunk)){
+    for(i = 0; i < sizeof(chunk); i++)
+      chunk[i] = (tot + i) % 251;
+    if(write(fds[1], chunk, sizeof(chunk)) != sizeof(chunk)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fds[1]);
+  wait(&xstatus);
+  exit(xstatus);
+}
+
 struct test slowtests[] = {
   {bigdir, "bigdir"},
   {manywrites, "manywrites"},
@@ -2946,6 +3719,8 @@ struct test slowtests[] = {
   {execout, "execout"},
   {diskfull, "diskfull"},
   {outofinodes, "outofinodes"},
+  {swaptest, "swaptest"},
+  {swappipe, "swappipe"},
     
   { 0, 0},
 };
@@ -32,8 +32,12 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
 entry("ttyraw");
+entry("mmap");
+entry("munmap");
+entry("spawn");
+entry("madvise");
+entry("pgaccess");
+entry("setnice");
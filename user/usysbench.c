@@ -0,0 +1,60 @@
+// getpid()/uptime() benchmark.
+//
+// getpid() and uptime() in ulib.c read the USYSCALL and
+// USHARED pages that the kernel maps into every process. This
+// times a loop of each against a loop of the same system call
+// made the old way, with ecall, through trampoline.S and
+// usertrap().
+//
+// usage: usysbench [calls]
+
+#include "kernel/types.h"
+#include "kernel/syscall.h"
+#include "user/user.h"
+
+// make system call num, with no arguments.
+static int
+trapcall(uint64 num)
+{
+  register uint64 a7 asm("a7") = num;
+  register uint64 a0 asm("a0");
+
+  asm volatile("ecall" : "=r" (a0) : "r" (a7) : "memory");
+  return a0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 1000000, t0, t1, t2, t3, sum = 0;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1){
+    fprintf(2, "usage: usysbench [calls]\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(int i = 0; i < n; i++)
+    sum += getpid();
+  t1 = uptime();
+  for(int i = 0; i < n; i++)
+    sum += trapcall(SYS_getpid);
+  t2 = uptime();
+  printf("usysbench: %d getpid()s: %d ticks from USYSCALL, %d ticks with ecall\n",
+         n, t1 - t0, t2 - t1);
+
+  t2 = uptime();
+  for(int i = 0; i < n; i++)
+    sum += uptime();
+  t3 = uptime();
+  for(int i = 0; i < n; i++)
+    sum += trapcall(SYS_uptime);
+  printf("usysbench: %d uptime()s: %d ticks from USHARED, %d ticks with ecall\n",
+         n, t3 - t2, uptime() - t3);
+
+  if(sum == 0)
+    printf("usysbench: %d\n", sum);  // so the loops aren't optimized away
+  exit(0);
+}
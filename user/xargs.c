@@ -64,13 +64,13 @@ main(int argc, char *argv[])
             // Parse line into words appended after base args
             parse_args(buf, xargv, base_argc);
 
-            // Run the cmd: one line -> one exec
-            if (fork() == 0) {
-                exec(xargv[0], xargv);
+            // Run the cmd: one line -> one spawn. The child
+            // needs nothing from xargs but its fds, so don't
+            // fork a copy of xargs just to exec over it.
+            if (spawn(xargv[0], xargv, 0, 0) < 0)
                 fprintf(2, "xargs: exec %s failed\n", xargv[0]);
-                exit(1);
-            }
-            wait(0);
+            else
+                wait(0);
 
             // Reset buffer
             n = 0;